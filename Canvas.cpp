@@ -1,131 +1,1029 @@
 #include "Canvas.hpp"
 #include "CanvasIterators.hpp"
+#include "CanvasCodec.hpp"
+#include "SharedCanvas.hpp"
 #include <algorithm>
+#include <array>
 #include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
 #include <exception>
+#include <fcntl.h>
 #include <fstream>
+#include <limits>
+#include <new>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <utility>
 
 namespace plotter
 {
 
-Canvas::Canvas(int width, int height, char background_char)
-    : width_(width), height_(height), background_(background_char),
-      data_(std::vector<char>(width * height, background_char))
+namespace
+{
+
+// Предел числа iovec в одном вызове writev (UIO_MAXIOV в Linux)
+constexpr size_t kMaxIovecs = 1024;
+
+void WriteAll(const int fd, std::vector<iovec>& batch)
+{
+    iovec* pending = batch.data();
+    size_t pending_count = batch.size();
+
+    while (pending_count > 0)
+    {
+        const ssize_t written = ::writev(fd, pending, static_cast<int>(pending_count));
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            throw std::runtime_error(std::string("writev error: ") + std::strerror(errno));
+        }
+
+        // Частичная запись: пропускаем записанные куски и дописываем остаток
+        size_t remaining = static_cast<size_t>(written);
+        while (pending_count > 0 && remaining >= pending->iov_len)
+        {
+            remaining -= pending->iov_len;
+            ++pending;
+            --pending_count;
+        }
+        if (pending_count > 0)
+        {
+            pending->iov_base = static_cast<char*>(pending->iov_base) + remaining;
+            pending->iov_len -= remaining;
+        }
+    }
+}
+
+std::string TextHeader(const int width, const int height, const char background)
+{
+    std::string header = "Canvas " + std::to_string(width) + 'x' + std::to_string(height) + '\n';
+    header += "Background: '" + std::string(1, background) + "'\n";
+    header += "Content:\n";
+    return header;
+}
+
+// Пишет в свежий холст только отличающиеся от фона куски строки
+void StoreRow(Canvas& canvas, const int y, const char* row, const char background)
+{
+    int x = 0;
+    while (x < canvas.Width())
+    {
+        while (x < canvas.Width() && row[x] == background)
+        {
+            ++x;
+        }
+        const int begin = x;
+        while (x < canvas.Width() && row[x] != background)
+        {
+            ++x;
+        }
+        if (begin < x)
+        {
+            canvas.WriteRow(begin, y, x - begin, row + begin);
+        }
+    }
+}
+
+// Пропускает count байт: перемоткой, если поток ее поддерживает
+void SkipBytes(std::istream& is, const uint64_t count)
+{
+    if (is.tellg() != std::istream::pos_type(-1))
+    {
+        is.seekg(static_cast<std::streamoff>(count), std::ios::cur);
+    }
+    else
+    {
+        is.ignore(static_cast<std::streamsize>(count));
+    }
+    if (!is)
+    {
+        throw std::runtime_error("unexpected end of canvas data");
+    }
+}
+
+// Переходит по индексу строк к строке top записи с первой строкой в
+// payload_begin. Запись не обязана начинаться в начале потока и кончаться
+// в его конце: хвост в конце потока принимается, только если указанный им
+// индекс кончается ровно перед хвостом. Иначе поток возвращается к первой
+// строке и результат - false
+bool SeekIndexedRow(std::istream& is, const std::istream::pos_type payload_begin, const int height,
+                    const int top)
+{
+    const auto record_begin = payload_begin - static_cast<std::streamoff>(CanvasCodec::kHeaderSize);
+    const auto index_size = static_cast<std::streamoff>(sizeof(uint64_t) * height);
+
+    is.seekg(-static_cast<std::streamoff>(CanvasCodec::kTrailerSize), std::ios::end);
+    const auto trailer_begin = is.tellg();
+    if (is && trailer_begin != std::istream::pos_type(-1) && trailer_begin - record_begin >= index_size)
+    {
+        const auto index_offset = CanvasCodec::ReadTrailer(is);
+        if (index_offset && *index_offset == static_cast<uint64_t>(trailer_begin - record_begin - index_size))
+        {
+            is.seekg(record_begin + static_cast<std::streamoff>(*index_offset + sizeof(uint64_t) * top));
+            const uint64_t row_offset = CanvasCodec::ReadU64(is);
+            if (row_offset > *index_offset - CanvasCodec::kHeaderSize)
+            {
+                throw std::runtime_error("corrupted canvas row index");
+            }
+            is.seekg(payload_begin + static_cast<std::streamoff>(row_offset));
+            return true;
+        }
+    }
+
+    is.clear();
+    is.seekg(payload_begin);
+    return false;
+}
+
+std::pair<int, int> ClipBand(const int y_begin, const int y_end, const int height)
+{
+    const int top = std::max(y_begin, 0);
+    const int bottom = std::min(y_end, height);
+    if (top >= bottom)
+    {
+        throw std::out_of_range("row band [" + std::to_string(y_begin) + ", " + std::to_string(y_end) +
+                                ") does not intersect canvas of height " + std::to_string(height));
+    }
+    return { top, bottom };
+}
+
+Canvas LoadTextRows(std::istream& is, const char* magic, const int y_begin, const int y_end,
+                    const Canvas::Storage storage)
+{
+    std::string line(magic, CanvasCodec::kMagicSize);
+    std::string rest;
+    std::getline(is, rest);
+    line += rest;
+
+    int width = 0;
+    int height = 0;
+    int consumed = 0;
+    if (std::sscanf(line.c_str(), "Canvas %dx%d%n", &width, &height, &consumed) != 2 ||
+        consumed != static_cast<int>(line.size()) || width <= 0 || height <= 0)
+    {
+        throw std::runtime_error("invalid canvas header: '" + line + "'");
+    }
+
+    std::getline(is, line);
+    if (line.size() != 15 || line.compare(0, 13, "Background: '") != 0 || line.back() != '\'')
+    {
+        throw std::runtime_error("invalid canvas background line: '" + line + "'");
+    }
+    const char background = line[13];
+
+    std::getline(is, line);
+    if (line != "Content:")
+    {
+        throw std::runtime_error("invalid canvas content marker: '" + line + "'");
+    }
+
+    const auto [top, bottom] = ClipBand(y_begin, y_end, height);
+    const size_t row_size = static_cast<size_t>(width) + 1;
+    SkipBytes(is, row_size * top);
+
+    Canvas canvas(width, bottom - top, background, storage);
+    std::vector<char> row(row_size);
+    for (int y = 0; y < canvas.Height(); ++y)
+    {
+        CanvasCodec::ReadExact(is, row.data(), row_size);
+        if (row.back() != '\n')
+        {
+            throw std::runtime_error("canvas row " + std::to_string(top + y) + " has wrong length");
+        }
+        StoreRow(canvas, y, row.data(), background);
+    }
+    return canvas;
+}
+
+Canvas LoadBinaryRows(std::istream& is, const int y_begin, const int y_end, const Canvas::Storage storage)
+{
+    const auto header = CanvasCodec::ReadHeader(is);
+    const auto [top, bottom] = ClipBand(y_begin, y_end, header.height);
+    const size_t width = static_cast<size_t>(header.width);
+
+    Canvas canvas(header.width, bottom - top, header.background, storage);
+    std::vector<char> row(width);
+
+    if (header.encoding == CanvasCodec::Encoding::Raw)
+    {
+        // Строки могут идти с отступами, как в файле отображенного холста
+        const uint64_t header_size = header.stride == width && header.data_offset == CanvasCodec::kHeaderSize
+            ? CanvasCodec::kHeaderSize
+            : CanvasCodec::kPaddedHeaderSize;
+        SkipBytes(is, header.data_offset - header_size + header.stride * top);
+        for (int y = 0; y < canvas.Height(); ++y)
+        {
+            if (y > 0)
+            {
+                SkipBytes(is, header.stride - width);
+            }
+            CanvasCodec::ReadExact(is, row.data(), width);
+            StoreRow(canvas, y, row.data(), header.background);
+        }
+        return canvas;
+    }
+
+    // По индексу сразу переходим к первой строке полосы, иначе
+    // пропускаем строки по их длинам, не распаковывая
+    const auto payload_begin = is.tellg();
+    const bool indexed = top > 0 && header.row_index && payload_begin != std::istream::pos_type(-1) &&
+        SeekIndexedRow(is, payload_begin, header.height, top);
+    if (!indexed)
+    {
+        for (int y = 0; y < top; ++y)
+        {
+            SkipBytes(is, CanvasCodec::ReadVarint(is));
+        }
+    }
+
+    // Пакет строки не бывает длиннее строки и байта заголовка на каждые 128 байт
+    const uint64_t max_packet = width + width / 128 + 1;
+    std::vector<char> packet;
+    for (int y = 0; y < canvas.Height(); ++y)
+    {
+        const uint64_t size = CanvasCodec::ReadVarint(is);
+        if (size > max_packet)
+        {
+            throw std::runtime_error("corrupted canvas row " + std::to_string(top + y));
+        }
+        packet.resize(size);
+        CanvasCodec::ReadExact(is, packet.data(), size);
+
+        CanvasCodec::DecodeRle(packet.data(), packet.size(), header.width,
+            [&](const int x, const char* data, const int count) { canvas.WriteRow(x, y, count, data); },
+            [&](const int x, const char value, const int count)
+            {
+                if (value != header.background)
+                {
+                    canvas.FillRegion(x, y, x + count - 1, y, value);
+                }
+            });
+    }
+    return canvas;
+}
+
+} // namespace
+
+Canvas::Canvas(int width, int height, char background_char, Storage storage)
+    : width_(width), height_(height), background_(background_char)
 {
     if (width < 0 || height < 0)
     {
-        throw std::runtime_error(
-            "negative params are forbidden, width: " + std::to_string(width) +
-            ", height: " + std::to_string(height));
+        throw std::runtime_error(
+            "negative params are forbidden, width: " + std::to_string(width) +
+            ", height: " + std::to_string(height));
+    }
+
+    if (storage == Storage::Tiled)
+    {
+        tiled_ = true;
+        tiles_x_ = (width + kTileSize - 1) >> kTileShift;
+        const size_t tiles_y = (height + kTileSize - 1) >> kTileShift;
+        tiles_.resize(tiles_x_ * tiles_y, Tile{{}, background_char});
+    }
+    else
+    {
+        data_.assign(static_cast<size_t>(width) * height, background_char);
+        pixels_ = data_.data();
+    }
+    stride_ = width;
+    dirty_.assign(height, {0, width - 1});
+    row_revisions_.assign(height, 0);
+}
+
+Canvas::Canvas(int width, int height, char background_char, std::unique_ptr<Mapping> mapping,
+               size_t data_offset, size_t stride)
+    : width_(width), height_(height), background_(background_char),
+      pixels_(mapping->base + data_offset), stride_(stride), mapping_(std::move(mapping))
+{
+    dirty_.assign(height, {0, width - 1});
+    row_revisions_.assign(height, 0);
+}
+
+Canvas::Canvas(const Canvas& other)
+    : width_(other.width_), height_(other.height_), background_(other.background_),
+      tiled_(other.tiled_), tiles_x_(other.tiles_x_), tiles_(other.tiles_), dirty_(other.dirty_),
+      row_revisions_(other.row_revisions_), revision_(other.revision_.load()), modified_(other.modified_.load())
+{
+    // Копия отображенного холста или холста с отступами - обычный плотный холст
+    if (!tiled_)
+    {
+        data_.resize(static_cast<size_t>(width_) * height_);
+        for (int y = 0; y < height_ && width_ > 0; ++y)
+        {
+            std::memcpy(data_.data() + static_cast<size_t>(y) * width_, other.pixels_ + y * other.stride_, width_);
+        }
+        pixels_ = data_.data();
+    }
+    stride_ = width_;
+}
+
+Canvas::Canvas(Canvas&& other) noexcept
+    : width_(0), height_(0), background_(' ')
+{
+    Swap(other);
+}
+
+Canvas& Canvas::operator=(const Canvas& other)
+{
+    if (this != &other)
+    {
+        Canvas tmp(other);
+        Swap(tmp);
+        AdvanceRevision(tmp);
+    }
+    return *this;
+}
+
+Canvas& Canvas::operator=(Canvas&& other) noexcept
+{
+    if (this != &other)
+    {
+        Canvas tmp(std::move(other));
+        Swap(tmp);
+        AdvanceRevision(tmp);
+    }
+    return *this;
+}
+
+Canvas::Mapping::~Mapping()
+{
+    ::munmap(base, length);
+    if (!shm_name.empty())
+    {
+        ::shm_unlink(shm_name.c_str());
+    }
+}
+
+Canvas Canvas::CreateMapped(const std::filesystem::path& filepath, int width, int height,
+                            char background_char, bool page_aligned_rows)
+{
+    if (width <= 0 || height <= 0)
+    {
+        throw std::runtime_error(
+            "mapped canvas must not be empty, width: " + std::to_string(width) +
+            ", height: " + std::to_string(height));
+    }
+
+    const size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    CanvasCodec::Header header{width, height, background_char, CanvasCodec::Encoding::Raw, false};
+    size_t data_offset = CanvasCodec::kHeaderSize;
+    size_t stride = static_cast<size_t>(width);
+    if (page_aligned_rows)
+    {
+        data_offset = page;
+        stride = (stride + page - 1) / page * page;
+        header.data_offset = data_offset;
+        header.stride = stride;
+    }
+    const size_t length = data_offset + stride * (height - 1) + width;
+
+    const int fd = ::open(filepath.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        throw std::runtime_error("failed to create file: " + filepath.string() + ": " + std::strerror(errno));
+    }
+
+    // Файл растет без записи: ядро выделит блоки только под тронутые страницы
+    std::string header_bytes;
+    CanvasCodec::AppendHeader(header, header_bytes);
+    if (::ftruncate(fd, static_cast<off_t>(length)) != 0 ||
+        ::pwrite(fd, header_bytes.data(), header_bytes.size(), 0) != static_cast<ssize_t>(header_bytes.size()))
+    {
+        const int error = errno;
+        ::close(fd);
+        throw std::runtime_error("failed to create file: " + filepath.string() + ": " + std::strerror(error));
+    }
+
+    void* base = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    const int error = errno;
+    ::close(fd);
+    if (base == MAP_FAILED)
+    {
+        throw std::runtime_error("failed to map file: " + filepath.string() + ": " + std::strerror(error));
+    }
+
+    Canvas canvas(width, height, background_char,
+                  std::unique_ptr<Mapping>(new Mapping{static_cast<char*>(base), length, filepath, true, {}, nullptr}),
+                  data_offset, stride);
+    // Нулевой фон уже лежит в пустом файле
+    if (background_char != '\0')
+    {
+        canvas.Clear(background_char);
+    }
+    return canvas;
+}
+
+Canvas Canvas::MapFile(const std::filesystem::path& filepath, MapMode mode)
+{
+    CanvasCodec::Header header{};
+    {
+        std::ifstream file(filepath, std::ios::binary);
+        if (!file.is_open())
+        {
+            throw std::runtime_error("failed to open file: " + filepath.string());
+        }
+        char magic[CanvasCodec::kMagicSize];
+        CanvasCodec::ReadExact(file, magic, sizeof(magic));
+        if (!CanvasCodec::IsBinary(magic))
+        {
+            throw std::runtime_error("only binary canvas files can be mapped: " + filepath.string());
+        }
+        header = CanvasCodec::ReadHeader(file);
+    }
+    if (header.encoding != CanvasCodec::Encoding::Raw)
+    {
+        throw std::runtime_error("only raw canvas rows can be mapped: " + filepath.string());
+    }
+
+    const bool shared = mode == MapMode::ReadWrite;
+    const int fd = ::open(filepath.c_str(), (shared ? O_RDWR : O_RDONLY) | O_CLOEXEC);
+    if (fd < 0)
+    {
+        throw std::runtime_error("failed to open file: " + filepath.string() + ": " + std::strerror(errno));
+    }
+
+    struct stat info{};
+    const size_t length = header.data_offset + header.stride * (header.height - 1) + header.width;
+    if (::fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < length)
+    {
+        ::close(fd);
+        throw std::runtime_error("canvas file is truncated: " + filepath.string());
+    }
+
+    void* base = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, shared ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+    const int error = errno;
+    ::close(fd);
+    if (base == MAP_FAILED)
+    {
+        throw std::runtime_error("failed to map file: " + filepath.string() + ": " + std::strerror(error));
+    }
+
+    return Canvas(header.width, header.height, header.background,
+                  std::unique_ptr<Mapping>(new Mapping{static_cast<char*>(base), length, filepath, shared, {}, nullptr}),
+                  header.data_offset, header.stride);
+}
+
+void Canvas::Persist() const
+{
+    if (mapping_ && mapping_->shared && ::msync(mapping_->base, mapping_->length, MS_SYNC) != 0)
+    {
+        throw std::runtime_error("failed to sync file: " + mapping_->path.string() + ": " + std::strerror(errno));
+    }
+}
+
+Canvas Canvas::CreateShared(const std::string& name, int width, int height, char background_char)
+{
+    if (width <= 0 || height <= 0)
+    {
+        throw std::runtime_error(
+            "shared canvas must not be empty, width: " + std::to_string(width) +
+            ", height: " + std::to_string(height));
+    }
+
+    const size_t frame_size = static_cast<size_t>(width) * height;
+    const size_t length = SharedFrameHeader::kBufferOffset + 2 * frame_size;
+
+    const int fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (fd < 0)
+    {
+        throw std::runtime_error("failed to create shared canvas " + name + ": " + std::strerror(errno));
+    }
+
+    void* base = MAP_FAILED;
+    int error = 0;
+    if (::ftruncate(fd, static_cast<off_t>(length)) == 0)
+    {
+        base = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    error = errno;
+    ::close(fd);
+    if (base == MAP_FAILED)
+    {
+        ::shm_unlink(name.c_str());
+        throw std::runtime_error("failed to map shared canvas " + name + ": " + std::strerror(error));
+    }
+
+    // Оба буфера начинают с пустого кадра 0; рисование идет во второй
+    auto* header = new (base) SharedFrameHeader{};
+    std::memcpy(header->magic, SharedFrameHeader::kMagic, sizeof(header->magic));
+    header->version = SharedFrameHeader::kVersion;
+    header->width = width;
+    header->height = height;
+    header->background = background_char;
+    std::memset(static_cast<char*>(base) + SharedFrameHeader::kBufferOffset, background_char, 2 * frame_size);
+
+    auto mapping = std::unique_ptr<Mapping>(new Mapping{static_cast<char*>(base), length, {}, true, name, header});
+    return Canvas(width, height, background_char, std::move(mapping),
+                  SharedFrameHeader::kBufferOffset + frame_size, static_cast<size_t>(width));
+}
+
+uint64_t Canvas::PublishFrame()
+{
+    if (!mapping_ || !mapping_->frame_header)
+    {
+        throw std::logic_error("only a shared canvas can publish frames");
+    }
+
+    SharedFrameHeader& header = *mapping_->frame_header;
+    char* const buffers = mapping_->base + SharedFrameHeader::kBufferOffset;
+    const size_t frame_size = static_cast<size_t>(Size());
+    const auto back = static_cast<uint32_t>((pixels_ - buffers) / frame_size);
+
+    // Запись seqlock: нечетный номер, смена буферов, следующий четный номер.
+    // Барьер не дает записям в бывший передний буфер обогнать нечетный номер
+    const uint64_t sequence = header.sequence.load(std::memory_order_relaxed);
+    header.sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    header.front.store(back, std::memory_order_relaxed);
+    const uint64_t frame = header.frame.load(std::memory_order_relaxed) + 1;
+    header.frame.store(frame, std::memory_order_relaxed);
+    header.sequence.store(sequence + 2, std::memory_order_release);
+
+    char* const next = buffers + (back ^ 1) * frame_size;
+    std::memcpy(next, pixels_, frame_size);
+    pixels_ = next;
+    return frame;
+}
+
+void Canvas::Swap(Canvas& other) noexcept
+{
+    std::swap(width_, other.width_);
+    std::swap(height_, other.height_);
+    std::swap(background_, other.background_);
+    std::swap(data_, other.data_);
+    std::swap(pixels_, other.pixels_);
+    std::swap(stride_, other.stride_);
+    std::swap(mapping_, other.mapping_);
+    std::swap(tiled_, other.tiled_);
+    std::swap(tiles_x_, other.tiles_x_);
+    std::swap(tiles_, other.tiles_);
+    std::swap(dirty_, other.dirty_);
+    std::swap(row_revisions_, other.row_revisions_);
+    revision_ = other.revision_.exchange(revision_);
+    modified_ = other.modified_.exchange(modified_);
+}
+
+[[nodiscard]] int Canvas::Width() const noexcept
+{
+    return width_;
+}
+
+[[nodiscard]] int Canvas::Height() const noexcept
+{
+    return height_;
+}
+
+[[nodiscard]] int Canvas::Size() const noexcept
+{
+    return Width() * Height();
+}
+
+Canvas::PixelRef Canvas::at(int x, int y)
+{
+    // Проверка границ та же, что у константного at
+    [[maybe_unused]] const char& pixel = std::as_const(*this).at(x, y);
+    return PixelRef(*this, x, y);
+}
+
+[[nodiscard]] const char& Canvas::at(int x, int y) const
+{
+    if (!InBounds(x, y))
+    {
+        throw std::out_of_range("pixel (" + std::to_string(x) + ", " +
+                                std::to_string(y) + ") is out of canvas");
+    }
+    if (tiled_)
+    {
+        return TileValue(x, y);
+    }
+    return pixels_[CalculateShift(x, y)];
+}
+
+Canvas::PixelRef Canvas::operator()(int x, int y) noexcept
+{
+    return PixelRef(*this, x, y);
+}
+
+[[nodiscard]] const char& Canvas::operator()(int x, int y) const noexcept
+{
+    if (tiled_)
+    {
+        return TileValue(x, y);
+    }
+    return pixels_[CalculateShift(x, y)];
+}
+
+char* Canvas::Data()
+{
+    char* pixels = DenseData();
+    RequireContiguous();
+    return pixels;
+}
+
+[[nodiscard]] const char* Canvas::Data() const noexcept
+{
+    return tiled_ || stride_ != static_cast<size_t>(width_) ? nullptr : pixels_;
+}
+
+[[nodiscard]] size_t Canvas::AllocatedTiles() const noexcept
+{
+    return std::count_if(tiles_.begin(), tiles_.end(),
+                         [](const Tile& tile) { return tile.pixels != nullptr; });
+}
+
+void Canvas::MakeDense()
+{
+    if (!tiled_)
+    {
+        return;
+    }
+
+    std::vector<char> data(static_cast<size_t>(width_) * height_);
+    for (int y = 0; y < height_; ++y)
+    {
+        for (int tile_x = 0; tile_x < tiles_x_; ++tile_x)
+        {
+            const Tile& tile = tiles_[TileIndex(tile_x << kTileShift, y)];
+            const int x = tile_x << kTileShift;
+            const int count = std::min(kTileSize, width_ - x);
+            char* dst = data.data() + static_cast<size_t>(y) * width_ + x;
+            if (!tile.pixels)
+            {
+                std::fill_n(dst, count, tile.fill);
+            }
+            else
+            {
+                const int row = y & (kTileSize - 1);
+                std::copy_n(tile.pixels.get() + row * kTileSize, count, dst);
+            }
+        }
+    }
+
+    data_ = std::move(data);
+    pixels_ = data_.data();
+    stride_ = width_;
+    tiles_ = {};
+    tiles_x_ = 0;
+    tiled_ = false;
+}
+
+CanvasView Canvas::View()
+{
+    return View(0, 0, width_, height_);
+}
+
+CanvasView Canvas::View(int x, int y, int width, int height)
+{
+    const CanvasView view = CanvasView(DenseData(), width_, height_, stride_).SubView(x, y, width, height);
+    if (!view.Empty())
+    {
+        const int left = std::max(x, 0);
+        const int top = std::max(y, 0);
+        MarkDirty(left, top, left + view.Width() - 1, top + view.Height() - 1);
+    }
+    return view;
+}
+
+std::span<char> Canvas::Row(int y)
+{
+    char* row = DenseData() + CalculateShift(0, y);
+    MarkDirty(0, y, width_ - 1, y);
+    return { row, static_cast<size_t>(width_) };
+}
+
+[[nodiscard]] std::span<const char> Canvas::Row(int y) const
+{
+    return { DenseData() + CalculateShift(0, y), static_cast<size_t>(width_) };
+}
+
+std::span<char> Canvas::Pixels()
+{
+    char* pixels = Data();
+    MarkDirty(0, 0, width_ - 1, height_ - 1);
+    return { pixels, static_cast<size_t>(Size()) };
+}
+
+[[nodiscard]] std::span<const char> Canvas::Pixels() const
+{
+    RequireContiguous();
+    return { DenseData(), static_cast<size_t>(Size()) };
+}
+
+[[nodiscard]] ConstCanvasView Canvas::View() const
+{
+    return View(0, 0, width_, height_);
+}
+
+[[nodiscard]] ConstCanvasView Canvas::View(int x, int y, int width, int height) const
+{
+    return ConstCanvasView(DenseData(), width_, height_, stride_).SubView(x, y, width, height);
+}
+
+void Canvas::ReadRow(int x, int y, int count, char* dst) const
+{
+    if (count <= 0)
+    {
+        return;
+    }
+
+    assert(InBounds(x, y) && x + count <= width_);
+    if (!tiled_)
+    {
+        std::memcpy(dst, pixels_ + CalculateShift(x, y), count);
+        return;
+    }
+
+    while (count > 0)
+    {
+        const int offset = x & (kTileSize - 1);
+        const int chunk = std::min(count, kTileSize - offset);
+        const Tile& tile = tiles_[TileIndex(x, y)];
+        if (!tile.pixels)
+        {
+            std::memset(dst, tile.fill, chunk);
+        }
+        else
+        {
+            std::memcpy(dst, tile.pixels.get() + ((y & (kTileSize - 1)) << kTileShift) + offset, chunk);
+        }
+        x += chunk;
+        dst += chunk;
+        count -= chunk;
+    }
+}
+
+void Canvas::WriteRow(int x, int y, int count, const char* src)
+{
+    if (count <= 0)
+    {
+        return;
+    }
+
+    assert(InBounds(x, y) && x + count <= width_);
+    MarkDirty(x, y, x + count - 1, y);
+    if (!tiled_)
+    {
+        // src может указывать в этот же холст
+        std::memmove(pixels_ + CalculateShift(x, y), src, count);
+        return;
+    }
+
+    while (count > 0)
+    {
+        const int chunk = std::min(count, kTileSize - (x & (kTileSize - 1)));
+        std::memcpy(&TilePixel(x, y), src, chunk);
+        x += chunk;
+        src += chunk;
+        count -= chunk;
     }
 }
 
-Canvas::Canvas(Canvas&& other) noexcept
+void Canvas::Clear(char fill_char)
 {
-    width_ = other.width_;
-    height_ = other.height_;
-    background_ = other.background_;
-    std::swap(data_, other.data_);
+    MarkDirty(0, 0, width_ - 1, height_ - 1);
+    if (tiled_)
+    {
+        FillTiles(0, 0, width_ - 1, height_ - 1, fill_char);
+        return;
+    }
+    for (int y = 0; y < height_; ++y)
+    {
+        std::memset(pixels_ + y * stride_, fill_char, width_);
+    }
 }
 
-Canvas& Canvas::operator=(const Canvas& other)
+void Canvas::FillRegion(int x1, int y1, int x2, int y2, char fill_char)
 {
-    if (this != &other)
+    const int left = std::max(std::min(x1, x2), 0);
+    const int right = std::min(std::max(x1, x2), Width() - 1);
+    const int top = std::max(std::min(y1, y2), 0);
+    const int bottom = std::min(std::max(y1, y2), Height() - 1);
+
+    if (left > right)
     {
-        Canvas tmp(other);
-        width_ = tmp.width_;
-        height_ = tmp.height_;
-        background_ = tmp.background_;
-        std::swap(data_, tmp.data_);
+        return;
+    }
+
+    MarkDirty(left, top, right, bottom);
+    if (tiled_)
+    {
+        FillTiles(left, top, right, bottom, fill_char);
+        return;
+    }
+
+    for (int y = top; y <= bottom; ++y)
+    {
+        std::memset(pixels_ + CalculateShift(left, y), fill_char, right - left + 1);
     }
-    return *this;
 }
 
-Canvas& Canvas::operator=(Canvas&& other) noexcept
+[[nodiscard]] bool Canvas::InBounds(int x, int y) const noexcept
 {
-    if (this != &other)
+    return x >= 0 && x < Width() && y >= 0 && y < Height();
+}
+
+[[nodiscard]] bool Canvas::IsDirty() const noexcept
+{
+    return std::any_of(dirty_.begin(), dirty_.end(),
+                       [](const auto& span) { return span.first <= span.second; });
+}
+
+std::vector<Canvas::DirtySpan> Canvas::DirtySpans() const
+{
+    std::vector<DirtySpan> spans;
+    for (int y = 0; y < height_; ++y)
     {
-        Canvas tmp(std::move(other));
-        width_ = tmp.width_;
-        height_ = tmp.height_;
-        background_ = tmp.background_;
-        std::swap(data_, tmp.data_);
+        if (dirty_[y].first <= dirty_[y].second)
+        {
+            spans.push_back({y, dirty_[y].first, dirty_[y].second});
+        }
     }
-    return *this;
+    return spans;
 }
 
-[[nodiscard]] int Canvas::Width() const noexcept
+std::vector<Canvas::DirtySpan> Canvas::Diff(const Canvas& base, const int max_gap) const
 {
-    return width_;
+    CheckDiffBase(base);
+    std::vector<DirtySpan> spans;
+    for (int y = 0; y < height_; ++y)
+    {
+        DiffRow(base, y, max_gap, spans);
+    }
+    return spans;
 }
 
-[[nodiscard]] int Canvas::Height() const noexcept
+std::vector<Canvas::DirtySpan> Canvas::Diff(const Canvas& base, const std::span<const int> rows,
+                                            const int max_gap) const
 {
-    return height_;
+    CheckDiffBase(base);
+    std::vector<DirtySpan> spans;
+    for (const int y : rows)
+    {
+        DiffRow(base, y, max_gap, spans);
+    }
+    return spans;
 }
 
-[[nodiscard]] int Canvas::Size() const noexcept
+void Canvas::CheckDiffBase(const Canvas& base) const
 {
-    return Width() * Height();
+    if (base.width_ != width_ || base.height_ != height_)
+    {
+        throw std::invalid_argument("canvases differ in size");
+    }
 }
 
-char& Canvas::at(int x, int y)
+void Canvas::DiffRow(const Canvas& base, const int y, const int max_gap, std::vector<DirtySpan>& spans) const
 {
-    return data_[CalculateShift(x, y)];
+    char scratch[kTileSize];
+    char base_scratch[kTileSize];
+    bool open = false;
+    for (int x = 0; x < width_; x += kTileSize)
+    {
+        // Общая плитка или две однородные с одним цветом совпадают без сравнения
+        if (tiled_ && base.tiled_)
+        {
+            const Tile& tile = tiles_[TileIndex(x, y)];
+            const Tile& base_tile = base.tiles_[base.TileIndex(x, y)];
+            if (tile.pixels == base_tile.pixels && (tile.pixels || tile.fill == base_tile.fill))
+            {
+                continue;
+            }
+        }
+
+        const int count = std::min(kTileSize, width_ - x);
+        const char* row = RowChunk(x, y, scratch);
+        const char* base_row = base.RowChunk(x, y, base_scratch);
+        if (std::memcmp(row, base_row, count) == 0)
+        {
+            continue;
+        }
+
+        for (int i = 0; i < count; ++i)
+        {
+            if (row[i] == base_row[i])
+            {
+                continue;
+            }
+            if (open && x + i - spans.back().x_end <= max_gap + 1)
+            {
+                spans.back().x_end = x + i;
+            }
+            else
+            {
+                spans.push_back({y, x + i, x + i});
+                open = true;
+            }
+        }
+    }
 }
 
-[[nodiscard]] const char& Canvas::at(int x, int y) const
+void Canvas::MarkDirty(int x1, int y1, int x2, int y2)
 {
-    return data_.at(CalculateShift(x, y));
+    const int left = std::max(std::min(x1, x2), 0);
+    const int right = std::min(std::max(x1, x2), Width() - 1);
+    const int top = std::max(std::min(y1, y2), 0);
+    const int bottom = std::min(std::max(y1, y2), Height() - 1);
+
+    for (int y = top; y <= bottom && left <= right; ++y)
+    {
+        dirty_[y].first = std::min(dirty_[y].first, left);
+        dirty_[y].second = std::max(dirty_[y].second, right);
+        ++row_revisions_[y];
+    }
+    if (top <= bottom && left <= right)
+    {
+        NoteWrite();
+    }
 }
 
-char& Canvas::operator()(int x, int y) noexcept
+[[nodiscard]] uint64_t Canvas::Revision() const noexcept
 {
-    return data_[CalculateShift(x, y)];
+    // Отметка снимается после сдвига: параллельный вызов либо тоже сдвинет
+    // номер, либо увидит уже сдвинутый
+    if (modified_.load())
+    {
+        ++revision_;
+        modified_ = false;
+    }
+    return revision_;
 }
 
-[[nodiscard]] const char& Canvas::operator()(int x, int y) const noexcept
+void Canvas::AdvanceRevision(const Canvas& previous) noexcept
 {
-    return data_[CalculateShift(x, y)];
+    // Присвоенный холст получает номера больше прежних и у каждой строки, и целиком
+    const size_t rows = std::min(row_revisions_.size(), previous.row_revisions_.size());
+    for (size_t y = 0; y < rows; ++y)
+    {
+        row_revisions_[y] = std::max(row_revisions_[y], previous.row_revisions_[y]) + 1;
+    }
+    revision_ = std::max(previous.Revision(), Revision()) + 1;
 }
 
-void Canvas::Clear(char fill_char)
+void Canvas::ResetDirty() noexcept
 {
-    std::fill(data_.begin(), data_.end(), fill_char);
+    std::fill(dirty_.begin(), dirty_.end(), std::pair{width_, -1});
 }
 
-void Canvas::FillRegion(int x1, int y1, int x2, int y2, char fill_char)
+void Canvas::ExportDirty(std::ostream& os)
 {
-    while (y1 < y2)
+    std::string content;
+    for (const auto& [y, x_begin, x_end] : DirtySpans())
     {
-        int shift_left = CalculateShift(x1, y1);
-        int shift_right = CalculateShift(x2, y2) + 1;
-        std::fill(data_.begin() + shift_left, data_.begin() + shift_right,
-                  fill_char);
-        ++y1;
+        content.clear();
+        for (int x = x_begin; x <= x_end; ++x)
+        {
+            content += std::as_const(*this)(x, y);
+        }
+        os << y << ' ' << x_begin << ' ' << content.size() << '|' << content << '\n';
     }
+    ResetDirty();
 }
 
-[[nodiscard]] bool Canvas::InBounds(int x, int y) const noexcept
+void Canvas::Render(std::ostream& os) const
 {
-    return x >= 0 && x < Width() && y >= 0 && y < Height();
+    ForEachRowSegment([&os](const char* segment, const size_t size)
+                      { os.write(segment, static_cast<std::streamsize>(size)); });
 }
 
-void Canvas::Render(std::ostream& os) const
+void Canvas::RenderToFd(int fd) const
 {
-    for (int i = 0; i < data_.size(); i += Width())
+    std::vector<iovec> batch;
+    batch.reserve(kMaxIovecs);
+
+    ForEachRowSegment([&](const char* segment, const size_t size)
     {
-        for (int j = 0; j < Width(); ++j)
+        if (size == 0)
         {
-            os << data_[i + j];
+            return;
         }
-        os << '\n';
-    }
 
-    os << std::flush;
+        batch.push_back({const_cast<char*>(segment), size});
+        if (batch.size() == kMaxIovecs)
+        {
+            WriteAll(fd, batch);
+            batch.clear();
+        }
+    });
+
+    WriteAll(fd, batch);
 }
 
 void Canvas::SaveToFile(const std::filesystem::path& filepath) const
+{
+    SaveToFile(filepath, FileFormat::Text);
+}
+
+void Canvas::SaveToFile(const std::filesystem::path& filepath, const FileFormat format,
+                        const bool row_index) const
 {
     std::filesystem::path absolute_path = std::filesystem::absolute(filepath);
 
@@ -143,18 +1041,52 @@ void Canvas::SaveToFile(const std::filesystem::path& filepath) const
         }
     }
 
-    std::ofstream out_file(absolute_path);
-    if (!out_file.is_open())
+    // Отображенный холст уже лежит в этом файле: достаточно сбросить страницы.
+    // Перезаписать его иначе нельзя - усечение файла обрушит отображение
+    std::error_code error;
+    if (mapping_ && std::filesystem::equivalent(absolute_path, mapping_->path, error))
+    {
+        if (format != FileFormat::Binary || !mapping_->shared)
+        {
+            throw std::logic_error("cannot overwrite the file backing a mapped canvas: " +
+                                   absolute_path.string());
+        }
+        Persist();
+        return;
+    }
+
+    const int fd = ::open(absolute_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
     {
         return;
     }
 
-    out_file << "Canvas " << Width() << 'x' << Height() << '\n';
-    out_file << "Background: " << '\'' << background_ << '\'' << '\n';
-    out_file << "Content:" << '\n';
-    Render(out_file);
+    try
+    {
+        if (format == FileFormat::Text)
+        {
+            std::string header = TextHeader(width_, height_, background_);
+            std::vector<iovec> header_batch = {{header.data(), header.size()}};
+            WriteAll(fd, header_batch);
+            RenderToFd(fd);
+        }
+        else
+        {
+            WriteBinary(format == FileFormat::BinaryRle, row_index, [fd](const char* chunk, const size_t size)
+            {
+                std::vector<iovec> batch = {{const_cast<char*>(chunk), size}};
+                WriteAll(fd, batch);
+            });
+        }
+    }
+    catch (const std::runtime_error& err)
+    {
+        ::close(fd);
+        throw std::runtime_error("failed to write to file: " +
+                                 absolute_path.string() + ": " + err.what());
+    }
 
-    if (out_file.fail())
+    if (::close(fd) != 0)
     {
         throw std::runtime_error("failed to write to file: " +
                                  absolute_path.string());
@@ -166,43 +1098,381 @@ void Canvas::SaveToFile(const std::string& filename) const
     return SaveToFile(std::filesystem::path(filename));
 }
 
+void Canvas::Save(std::ostream& os, const FileFormat format, const bool row_index) const
+{
+    if (format == FileFormat::Text)
+    {
+        os << TextHeader(width_, height_, background_);
+        Render(os);
+        return;
+    }
+
+    WriteBinary(format == FileFormat::BinaryRle, row_index, [&os](const char* chunk, const size_t size)
+                { os.write(chunk, static_cast<std::streamsize>(size)); });
+}
+
+Canvas Canvas::Load(std::istream& is, const Storage storage)
+{
+    return LoadRows(is, 0, std::numeric_limits<int>::max(), storage);
+}
+
+Canvas Canvas::LoadFromFile(const std::filesystem::path& filepath, const Storage storage)
+{
+    return LoadRowsFromFile(filepath, 0, std::numeric_limits<int>::max(), storage);
+}
+
+Canvas Canvas::LoadRows(std::istream& is, const int y_begin, const int y_end, const Storage storage)
+{
+    char magic[CanvasCodec::kMagicSize];
+    CanvasCodec::ReadExact(is, magic, sizeof(magic));
+    if (CanvasCodec::IsBinary(magic))
+    {
+        return LoadBinaryRows(is, y_begin, y_end, storage);
+    }
+    return LoadTextRows(is, magic, y_begin, y_end, storage);
+}
+
+Canvas Canvas::LoadRowsFromFile(const std::filesystem::path& filepath, const int y_begin, const int y_end,
+                                const Storage storage)
+{
+    std::ifstream file(filepath, std::ios::binary);
+    if (!file.is_open())
+    {
+        throw std::runtime_error("failed to open file: " + filepath.string());
+    }
+
+    try
+    {
+        return LoadRows(file, y_begin, y_end, storage);
+    }
+    catch (const std::runtime_error& err)
+    {
+        throw std::runtime_error("failed to load canvas from " + filepath.string() + ": " + err.what());
+    }
+}
+
 Canvas::RowIterator Canvas::RowBegin(int row)
 {
-    return Canvas::RowIterator(this, 0, row);
+    // Строке нужна только своя непрерывность: строки с отступами тоже подходят
+    char* first = DenseData() + CalculateShift(0, row);
+    MarkDirty(0, row, width_ - 1, row);
+    return RowIterator(first, first, first + width_);
 }
 
 Canvas::RowIterator Canvas::RowEnd(int row)
 {
-    return Canvas::RowIterator(this, Width(), row);
+    // Конец не помечает строку: ее уже помечает RowBegin
+    char* first = DenseData() + CalculateShift(0, row);
+    return RowIterator(first + width_, first, first + width_);
+}
+
+Canvas::ConstRowIterator Canvas::RowBegin(int row) const
+{
+    const char* first = DenseData() + CalculateShift(0, row);
+    return ConstRowIterator(first, first, first + width_);
+}
+
+Canvas::ConstRowIterator Canvas::RowEnd(int row) const
+{
+    return RowBegin(row) + width_;
 }
 
 Canvas::ColumnIterator Canvas::ColBegin(int col)
 {
-    return Canvas::ColumnIterator(this, col, 0);
+    char* first = DenseData() + CalculateShift(col, 0);
+    MarkDirty(col, 0, col, height_ - 1);
+    return ColumnIterator(first, static_cast<std::ptrdiff_t>(stride_), 0, height_);
 }
 
 Canvas::ColumnIterator Canvas::ColEnd(int col)
 {
-    return Canvas::ColumnIterator(this, col, Height());
+    return ColumnIterator(DenseData() + CalculateShift(col, 0), static_cast<std::ptrdiff_t>(stride_), height_,
+                          height_);
+}
+
+Canvas::ConstColumnIterator Canvas::ColBegin(int col) const
+{
+    return ConstColumnIterator(DenseData() + CalculateShift(col, 0), static_cast<std::ptrdiff_t>(stride_), 0,
+                               height_);
+}
+
+Canvas::ConstColumnIterator Canvas::ColEnd(int col) const
+{
+    return ColBegin(col) + height_;
 }
 
 Canvas::PixelIterator Canvas::begin()
 {
-    return Canvas::PixelIterator(this, 0);
+    char* first = Data();
+    MarkDirty(0, 0, width_ - 1, height_ - 1);
+    return PixelIterator(first, first, first + Size());
 }
 
 Canvas::PixelIterator Canvas::end()
 {
-    return Canvas::PixelIterator(this, data_.size());
+    char* first = Data();
+    return PixelIterator(first + Size(), first, first + Size());
+}
+
+Canvas::ConstPixelIterator Canvas::begin() const
+{
+    RequireContiguous();
+    const char* first = DenseData();
+    return ConstPixelIterator(first, first, first + Size());
+}
+
+Canvas::ConstPixelIterator Canvas::end() const
+{
+    return begin() + Size();
+}
+
+Canvas::ConstPixelIterator Canvas::cbegin() const
+{
+    return begin();
+}
+
+Canvas::ConstPixelIterator Canvas::cend() const
+{
+    return end();
+}
+
+const char* Canvas::DenseData() const
+{
+    if (tiled_)
+    {
+        throw std::logic_error("tiled canvas has no contiguous pixel range, call MakeDense() first");
+    }
+    return pixels_;
+}
+
+char* Canvas::DenseData()
+{
+    return const_cast<char*>(std::as_const(*this).DenseData());
+}
+
+void Canvas::RequireContiguous() const
+{
+    if (stride_ != static_cast<size_t>(width_))
+    {
+        throw std::logic_error("canvas rows are padded and do not form one contiguous range");
+    }
 }
 
 size_t Canvas::CalculateShift(int x, int y) const
 {
     assert(x >= 0);
     assert(y >= 0);
-    size_t shift = x + y * Width();
-    assert(shift < Size());
-    return shift;
+    assert(x < width_ && y < height_);
+    return x + y * stride_;
+}
+
+// Обходит холст построчно непрерывными кусками вместе с переводами строк,
+// не копируя пиксели: плотная строка - один кусок, плиточная - по куску на плитку
+template <typename Sink>
+void Canvas::ForEachRowSegment(Sink&& sink) const
+{
+    static constexpr char kNewline = '\n';
+
+    if (!tiled_)
+    {
+        for (int y = 0; y < height_; ++y)
+        {
+            sink(pixels_ + y * stride_, static_cast<size_t>(width_));
+            sink(&kNewline, 1);
+        }
+        return;
+    }
+
+    // Однородная плитка ссылается на строку из kTileSize своих символов.
+    // Таблица статическая: приемник может держать куски и после возврата
+    static const auto fill_rows = []
+    {
+        std::array<std::array<char, kTileSize>, 256> rows{};
+        for (size_t c = 0; c < rows.size(); ++c)
+        {
+            rows[c].fill(static_cast<char>(c));
+        }
+        return rows;
+    }();
+
+    for (int y = 0; y < height_; ++y)
+    {
+        for (int x = 0; x < width_; x += kTileSize)
+        {
+            const Tile& tile = tiles_[TileIndex(x, y)];
+            const char* row = !tile.pixels
+                ? fill_rows[static_cast<unsigned char>(tile.fill)].data()
+                : tile.pixels.get() + ((y & (kTileSize - 1)) << kTileShift);
+            sink(row, static_cast<size_t>(std::min(kTileSize, width_ - x)));
+        }
+        sink(&kNewline, 1);
+    }
+}
+
+// Пишет холст в двоичном формате CanvasCodec блоками примерно по kChunkSize байт
+template <typename Sink>
+void Canvas::WriteBinary(const bool rle, const bool row_index, Sink&& sink) const
+{
+    static constexpr size_t kChunkSize = 64 * 1024;
+
+    // Строки Raw имеют постоянную длину, индекс нужен только для Rle
+    const bool with_index = rle && row_index;
+    std::string out;
+    out.reserve(kChunkSize + 2 * static_cast<size_t>(width_));
+    CanvasCodec::AppendHeader({width_, height_, background_,
+                               rle ? CanvasCodec::Encoding::Rle : CanvasCodec::Encoding::Raw, with_index}, out);
+
+    std::vector<uint64_t> offsets;
+    offsets.reserve(with_index ? height_ : 0);
+    uint64_t payload_size = 0;
+    std::vector<char> scratch(tiled_ ? width_ : 0);
+
+    for (int y = 0; y < height_; ++y)
+    {
+        const char* row = pixels_ + y * stride_;
+        if (tiled_)
+        {
+            ReadRow(0, y, width_, scratch.data());
+            row = scratch.data();
+        }
+
+        const size_t before = out.size();
+        if (rle)
+        {
+            CanvasCodec::AppendRleRow(row, width_, out);
+        }
+        else
+        {
+            out.append(row, width_);
+        }
+
+        if (with_index)
+        {
+            offsets.push_back(payload_size);
+        }
+        payload_size += out.size() - before;
+
+        if (out.size() >= kChunkSize)
+        {
+            sink(out.data(), out.size());
+            out.clear();
+        }
+    }
+
+    if (with_index)
+    {
+        for (const uint64_t offset : offsets)
+        {
+            CanvasCodec::AppendU64(offset, out);
+        }
+        // Смещение от начала записи: холст может лежать в потоке не первым
+        CanvasCodec::AppendTrailer(CanvasCodec::kHeaderSize + payload_size, out);
+    }
+    sink(out.data(), out.size());
+}
+
+size_t Canvas::TileIndex(int x, int y) const
+{
+    assert(InBounds(x, y));
+    return static_cast<size_t>(y >> kTileShift) * tiles_x_ + (x >> kTileShift);
+}
+
+char& Canvas::TilePixel(int x, int y)
+{
+    Tile& tile = tiles_[TileIndex(x, y)];
+    if (!tile.pixels || tile.pixels.use_count() > 1)
+    {
+        // Однородная или общая с другой копией холста плитка получает свои пиксели
+        auto pixels = std::make_shared_for_overwrite<char[]>(kTileSize * kTileSize);
+        if (tile.pixels)
+        {
+            std::copy_n(tile.pixels.get(), kTileSize * kTileSize, pixels.get());
+        }
+        else
+        {
+            std::fill_n(pixels.get(), kTileSize * kTileSize, tile.fill);
+        }
+        tile.pixels = std::move(pixels);
+    }
+    return tile.pixels[((y & (kTileSize - 1)) << kTileShift) + (x & (kTileSize - 1))];
+}
+
+const char& Canvas::TileValue(int x, int y) const
+{
+    const Tile& tile = tiles_[TileIndex(x, y)];
+    if (!tile.pixels)
+    {
+        return tile.fill;
+    }
+    return tile.pixels[((y & (kTileSize - 1)) << kTileShift) + (x & (kTileSize - 1))];
+}
+
+// Участок строки y от x (кратного kTileSize) до конца плитки. Однородная
+// плитка разворачивается в scratch
+const char* Canvas::RowChunk(int x, int y, char* scratch) const
+{
+    if (!tiled_)
+    {
+        return pixels_ + CalculateShift(x, y);
+    }
+
+    const Tile& tile = tiles_[TileIndex(x, y)];
+    if (!tile.pixels)
+    {
+        std::memset(scratch, tile.fill, kTileSize);
+        return scratch;
+    }
+    return tile.pixels.get() + ((y & (kTileSize - 1)) << kTileShift);
+}
+
+void Canvas::FillTiles(int left, int top, int right, int bottom, char fill_char)
+{
+    for (int tile_y = top >> kTileShift; tile_y <= bottom >> kTileShift; ++tile_y)
+    {
+        for (int tile_x = left >> kTileShift; tile_x <= right >> kTileShift; ++tile_x)
+        {
+            const int x0 = tile_x << kTileShift;
+            const int y0 = tile_y << kTileShift;
+            const int x1 = std::min(x0 + kTileSize, width_) - 1;
+            const int y1 = std::min(y0 + kTileSize, height_) - 1;
+            Tile& tile = tiles_[TileIndex(x0, y0)];
+
+            // Плитка накрыта целиком - достаточно сменить ее состояние
+            if (left <= x0 && right >= x1 && top <= y0 && bottom >= y1)
+            {
+                tile.pixels = nullptr;
+                tile.fill = fill_char;
+                continue;
+            }
+
+            for (int y = std::max(top, y0); y <= std::min(bottom, y1); ++y)
+            {
+                char* row = &TilePixel(x0, y);
+                std::fill(row + std::max(left, x0) - x0, row + std::min(right, x1) - x0 + 1, fill_char);
+            }
+        }
+    }
+}
+
+void Canvas::WritePixel(int x, int y, char value)
+{
+    MarkPixel(x, y);
+    if (tiled_)
+    {
+        TilePixel(x, y) = value;
+        return;
+    }
+    pixels_[CalculateShift(x, y)] = value;
+}
+
+void Canvas::MarkPixel(int x, int y) noexcept
+{
+    assert(y >= 0 && y < height_);
+    auto& [begin, end] = dirty_[y];
+    begin = std::min(begin, x);
+    end = std::max(end, x);
+    ++row_revisions_[y];
+    NoteWrite();
 }
 
 } // namespace plotter
\ No newline at end of file
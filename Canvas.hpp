@@ -1,21 +1,71 @@
 #pragma once
+#include "CanvasView.hpp"
+#include <atomic>
 #include <filesystem>
+#include <cstdint>
 #include <iostream>
+#include <memory>
+#include <span>
+#include <utility>
 #include <vector>
 
 namespace plotter
 {
 
+struct SharedFrameHeader;
+
 class Canvas
 {
 public:
-    class RowIterator;
-    class ColumnIterator;
-    class PixelIterator;
+    template <typename Char>
+    class ContiguousIterator;
+    template <typename Char>
+    class StridedIterator;
+    class PixelRef;
+
+    using PixelIterator = ContiguousIterator<char>;
+    using ConstPixelIterator = ContiguousIterator<const char>;
+    using RowIterator = ContiguousIterator<char>;
+    using ConstRowIterator = ContiguousIterator<const char>;
+    using ColumnIterator = StridedIterator<char>;
+    using ConstColumnIterator = StridedIterator<const char>;
+
+    enum class Storage
+    {
+        Dense,
+        Tiled, // плитки kTileSize x kTileSize выделяются при первой записи
+    };
+
+    // Text - заголовок и строки как в SaveToFile; двоичные форматы описаны в CanvasCodec.hpp
+    enum class FileFormat
+    {
+        Text,
+        Binary,
+        BinaryRle,
+    };
 
-    Canvas(int width, int height, char background_char = ' ');
+    // Измененный с последней контрольной точки отрезок строки [x_begin, x_end]
+    struct DirtySpan
+    {
+        int y;
+        int x_begin;
+        int x_end;
+    };
 
-    Canvas(const Canvas& other) = default;
+    enum class MapMode
+    {
+        ReadWrite, // MAP_SHARED: запись сразу попадает в страничный кэш файла
+        ReadOnly,  // файл не меняется: запись в холст остается в частной копии страниц
+    };
+
+    static constexpr int kTileShift = 6;
+    static constexpr int kTileSize = 1 << kTileShift;
+
+    Canvas(int width, int height, char background_char = ' ', Storage storage = Storage::Dense);
+
+    // Копия живет в памяти. Плиточный холст копирует только таблицу плиток:
+    // пиксели общие, пока одна из копий не запишет в плитку
+    Canvas(const Canvas& other);
     Canvas(Canvas&& other) noexcept;
     Canvas& operator=(const Canvas& other);
     Canvas& operator=(Canvas&& other) noexcept;
@@ -24,34 +74,249 @@ public:
     [[nodiscard]] int Height() const noexcept;
     [[nodiscard]] int Size() const noexcept;
 
-    char& at(int x, int y);
+    // Изменяемый доступ возвращает PixelRef: чтение через него холст не
+    // помечает, а присваивание помечает пиксель и двигает ревизию строки
+    PixelRef at(int x, int y);
     [[nodiscard]] const char& at(int x, int y) const;
-    char& operator()(int x, int y) noexcept;
+    PixelRef operator()(int x, int y) noexcept;
     [[nodiscard]] const char& operator()(int x, int y) const noexcept;
 
+    // Холст, пиксели которого лежат в файле двоичного формата Raw и
+    // отображаются через mmap: страницы подгружает и вытесняет ядро.
+    // page_aligned_rows начинает каждую строку с границы страницы.
+    // Копия отображенного холста живет в памяти
+    static Canvas CreateMapped(const std::filesystem::path& filepath, int width, int height,
+                               char background_char = ' ', bool page_aligned_rows = false);
+    static Canvas MapFile(const std::filesystem::path& filepath, MapMode mode = MapMode::ReadWrite);
+    [[nodiscard]] bool IsMapped() const noexcept { return mapping_ != nullptr; }
+    // Сбрасывает измененные страницы отображения на диск (msync); для
+    // холста в памяти ничего не делает
+    void Persist() const;
+
+    // Холст в сегменте общей памяти POSIX (shm_open) с двумя буферами кадра:
+    // рисование идет в задний, PublishFrame делает его готовым кадром для
+    // SharedCanvasReader в другом процессе. Сегмент удаляется вместе с холстом
+    static Canvas CreateShared(const std::string& name, int width, int height, char background_char = ' ');
+    // Публикует нарисованный кадр и продолжает рисование с его копии во
+    // втором буфере. Возвращает номер кадра; для обычного холста бросает
+    // std::logic_error
+    uint64_t PublishFrame();
+
+    // Непрерывный буфер пикселей. У плиточного холста и у строк с отступами
+    // общего буфера нет: неконстантный Data(), Pixels() и итераторы по всем
+    // пикселям бросают std::logic_error, константный Data() возвращает nullptr
+    char* Data();
+    [[nodiscard]] const char* Data() const noexcept;
+
+    [[nodiscard]] bool IsTiled() const noexcept { return tiled_; }
+    [[nodiscard]] size_t AllocatedTiles() const noexcept;
+    // Выделяет все W * H пикселей плиточного холста. Сам холст в плотный
+    // не переходит никогда: буфер, окна, строки и итераторы плиточного
+    // холста бросают std::logic_error, пока не вызван MakeDense, а
+    // попиксельная запись и WriteRow выделяют только свою плитку
+    void MakeDense();
+
+    // Снимок - та же копия: для плиточного холста O(число плиток) и
+    // копирование плитки при первой записи, для плотного - весь буфер
+    [[nodiscard]] Canvas Snapshot() const { return *this; }
+    // Отрезки строк, которыми холст отличается от base того же размера
+    // (иначе std::invalid_argument). Отрезки, между которыми не больше
+    // max_gap совпадающих пикселей, сливаются. Плитки, общие со снимком
+    // base, не сравниваются
+    [[nodiscard]] std::vector<DirtySpan> Diff(const Canvas& base, int max_gap = 0) const;
+    // То же только для строк rows: остальные считаются совпадающими
+    [[nodiscard]] std::vector<DirtySpan> Diff(const Canvas& base, std::span<const int> rows,
+                                              int max_gap = 0) const;
+
+    // Окно в буфер холста, обрезанное по его границам. Изменяемое окно
+    // сразу помечает свою область грязной. Для плиточного холста оба
+    // бросают std::logic_error
+    CanvasView View();
+    CanvasView View(int x, int y, int width, int height);
+    [[nodiscard]] ConstCanvasView View() const;
+    [[nodiscard]] ConstCanvasView View(int x, int y, int width, int height) const;
+
+    // Строка и весь буфер как std::span; правила хранения те же, что у View.
+    // Вместе с View (двумерное окно с шагом) заменяют std::mdspan
+    std::span<char> Row(int y);
+    [[nodiscard]] std::span<const char> Row(int y) const;
+    std::span<char> Pixels();
+    [[nodiscard]] std::span<const char> Pixels() const;
+
+    // Построчное копирование count пикселей начиная с (x, y) для любого хранения
+    void ReadRow(int x, int y, int count, char* dst) const;
+    void WriteRow(int x, int y, int count, const char* src);
+
     void Clear(char fill_char);
     void FillRegion(int x1, int y1, int x2, int y2, char fill_char);
 
     [[nodiscard]] bool InBounds(int x, int y) const noexcept;
 
+    // Изменения отслеживаются по строкам: каждая неконстантная запись
+    // расширяет отрезок своей строки. Новый холст целиком грязный.
+    // Запись через Data() нужно отметить вызовом MarkDirty
+    [[nodiscard]] bool IsDirty() const noexcept;
+    [[nodiscard]] std::vector<DirtySpan> DirtySpans() const;
+    void MarkDirty(int x1, int y1, int x2, int y2);
+    void ResetDirty() noexcept;
+    // Пишет измененные отрезки строками "y x length|content" и ставит контрольную точку
+    void ExportDirty(std::ostream& os);
+    // Номер правки: вызов Revision() после записи, которую видит отслеживание
+    // изменений, или после присваивания холста вернет большее число;
+    // ResetDirty его не сбрасывает. Запись только ставит отметку, а номер
+    // сдвигает сам Revision(), поэтому проверка стоит O(1), а потоки, пишущие
+    // разные строки, не делят счетчик. RowRevision - счетчик записей строки y
+    [[nodiscard]] uint64_t Revision() const noexcept;
+    [[nodiscard]] uint64_t RowRevision(int y) const noexcept { return row_revisions_[y]; }
+
+    // Выводит холст блоками строк и не сбрасывает поток: flush - решение вызывающего
     void Render(std::ostream& os = std::cout) const;
+    // Пишет строки прямо из буфера холста в файловый дескриптор через writev
+    void RenderToFd(int fd) const;
     void SaveToFile(const std::filesystem::path& filepath) const;
     void SaveToFile(const std::string& filename) const;
+    // Двоичные форматы пишутся потоково, блоками строк. row_index добавляет
+    // индекс строк, по которому LoadRows переходит к полосе без разбора
+    void SaveToFile(const std::filesystem::path& filepath, FileFormat format, bool row_index = false) const;
+    void Save(std::ostream& os, FileFormat format = FileFormat::Text, bool row_index = false) const;
 
+    // Формат определяется по сигнатуре; ошибки разбора - std::runtime_error.
+    // Строки, совпадающие с фоном, не записываются, поэтому плиточный
+    // холст после загрузки выделяет плитки только под содержимое
+    static Canvas Load(std::istream& is, Storage storage = Storage::Dense);
+    static Canvas LoadFromFile(const std::filesystem::path& filepath, Storage storage = Storage::Dense);
+    // Полоса строк [y_begin, y_end), обрезанная по высоте сохраненного холста
+    static Canvas LoadRows(std::istream& is, int y_begin, int y_end, Storage storage = Storage::Dense);
+    static Canvas LoadRowsFromFile(const std::filesystem::path& filepath, int y_begin, int y_end,
+                                   Storage storage = Storage::Dense);
+
+    // Итераторы идут по непрерывному буферу, как и View: изменяемые помечают
+    // свой диапазон грязным, и все для плиточного холста бросают
+    // std::logic_error. Строкам
+    // и столбцам хватает шага строк, поэтому они работают и на холсте с
+    // отступами строк; begin/end по всему холсту там бросают std::logic_error
     RowIterator RowBegin(int row);
     RowIterator RowEnd(int row);
+    [[nodiscard]] ConstRowIterator RowBegin(int row) const;
+    [[nodiscard]] ConstRowIterator RowEnd(int row) const;
     ColumnIterator ColBegin(int col);
     ColumnIterator ColEnd(int col);
+    [[nodiscard]] ConstColumnIterator ColBegin(int col) const;
+    [[nodiscard]] ConstColumnIterator ColEnd(int col) const;
     PixelIterator begin();
     PixelIterator end();
+    [[nodiscard]] ConstPixelIterator begin() const;
+    [[nodiscard]] ConstPixelIterator end() const;
+    [[nodiscard]] ConstPixelIterator cbegin() const;
+    [[nodiscard]] ConstPixelIterator cend() const;
 
 private:
+    // Плитка без пикселей целиком равна fill. Пиксели могут делить несколько
+    // копий холста: перед записью TilePixel копирует разделенную плитку
+    struct Tile
+    {
+        std::shared_ptr<char[]> pixels;
+        char fill;
+    };
+
+    // Отображение файла; освобождается вместе с холстом
+    struct Mapping
+    {
+        char* base;
+        size_t length;
+        std::filesystem::path path;
+        bool shared;
+        // Для общей памяти: имя сегмента и его заголовок
+        std::string shm_name;
+        SharedFrameHeader* frame_header = nullptr;
+
+        ~Mapping();
+    };
+
     int width_;
     int height_;
     char background_;
     std::vector<char> data_;
+    // Начало пикселей плотного холста (data_ или отображение) и шаг строк
+    char* pixels_ = nullptr;
+    size_t stride_ = 0;
+    std::unique_ptr<Mapping> mapping_;
+    bool tiled_ = false;
+    int tiles_x_ = 0;
+    std::vector<Tile> tiles_;
+    std::vector<std::pair<int, int>> dirty_;
+    std::vector<uint64_t> row_revisions_;
+    mutable std::atomic<uint64_t> revision_ = 0;
+    // Запись после последнего Revision()
+    mutable std::atomic<bool> modified_ = false;
 
+    Canvas(int width, int height, char background_char, std::unique_ptr<Mapping> mapping, size_t data_offset,
+           size_t stride);
+
+    void Swap(Canvas& other) noexcept;
     size_t CalculateShift(int x, int y) const;
+    template <typename Sink>
+    void ForEachRowSegment(Sink&& sink) const;
+    template <typename Sink>
+    void WriteBinary(bool rle, bool row_index, Sink&& sink) const;
+    size_t TileIndex(int x, int y) const;
+    char& TilePixel(int x, int y);
+    const char& TileValue(int x, int y) const;
+    const char* RowChunk(int x, int y, char* scratch) const;
+    void CheckDiffBase(const Canvas& base) const;
+    void DiffRow(const Canvas& base, int y, int max_gap, std::vector<DirtySpan>& spans) const;
+    void FillTiles(int left, int top, int right, int bottom, char fill_char);
+    void MarkPixel(int x, int y) noexcept;
+    void WritePixel(int x, int y, char value);
+    void NoteWrite() noexcept
+    {
+        // Отметка уже стоит почти всегда: чтение не отнимает строку кэша у других потоков
+        if (!modified_.load(std::memory_order_relaxed))
+        {
+            modified_.store(true, std::memory_order_relaxed);
+        }
+    }
+    void AdvanceRevision(const Canvas& previous) noexcept;
+    // Плотный буфер; у плиточного холста его нет - std::logic_error
+    const char* DenseData() const;
+    char* DenseData();
+    void RequireContiguous() const;
+};
+
+// Пиксель изменяемого холста: чтение идет мимо отметок изменений, запись -
+// через холст, как при рисовании
+class Canvas::PixelRef
+{
+public:
+    PixelRef& operator=(char value)
+    {
+        canvas_->WritePixel(x_, y_, value);
+        return *this;
+    }
+
+    // Копирует значение пикселя, а не ссылку
+    PixelRef& operator=(const PixelRef& other)
+    {
+        return *this = static_cast<char>(other);
+    }
+
+    operator char() const noexcept
+    {
+        return std::as_const(*canvas_)(x_, y_);
+    }
+
+private:
+    friend class Canvas;
+
+    PixelRef(Canvas& canvas, int x, int y) noexcept
+        : canvas_(&canvas), x_(x), y_(y)
+    {
+    }
+    PixelRef(const PixelRef&) = default;
+
+    Canvas* canvas_;
+    int x_;
+    int y_;
 };
 
 } // namespace plotter
@@ -0,0 +1,219 @@
+#include "CanvasCodec.hpp"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+namespace plotter
+{
+
+namespace
+{
+
+constexpr char kMagic[] = "ACNV";
+constexpr char kTrailerMagic[] = "ACNI";
+
+// Повтор короче трех байт выгоднее оставить внутри литерала
+constexpr size_t kMinRun = 3;
+constexpr size_t kMaxRun = 130;
+constexpr size_t kMaxLiteral = 128;
+
+void AppendU32(const uint32_t value, std::string& out)
+{
+    for (int shift = 0; shift < 32; shift += 8)
+    {
+        out += static_cast<char>((value >> shift) & 0xFF);
+    }
+}
+
+void AppendVarint(uint64_t value, std::string& out)
+{
+    while (value >= 0x80)
+    {
+        out += static_cast<char>((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    out += static_cast<char>(value);
+}
+
+uint64_t DecodeLittleEndian(const char* bytes, const int size)
+{
+    uint64_t value = 0;
+    for (int i = size - 1; i >= 0; --i)
+    {
+        value = (value << 8) | static_cast<unsigned char>(bytes[i]);
+    }
+    return value;
+}
+
+int CheckedDimension(const uint64_t value, const char* name)
+{
+    if (value == 0 || value > INT_MAX)
+    {
+        throw std::runtime_error(std::string("invalid canvas ") + name + ": " + std::to_string(value));
+    }
+    return static_cast<int>(value);
+}
+
+} // namespace
+
+[[nodiscard]] bool CanvasCodec::IsBinary(const char* magic) noexcept
+{
+    return std::memcmp(magic, kMagic, kMagicSize) == 0;
+}
+
+void CanvasCodec::AppendHeader(const Header& header, std::string& out)
+{
+    out.append(kMagic, kMagicSize);
+    out += static_cast<char>(kVersion);
+    out += static_cast<char>(header.encoding);
+    const bool padded = header.stride != 0;
+    out += static_cast<char>((header.row_index ? kRowIndexFlag : 0) | (padded ? kPaddedRowsFlag : 0));
+    out += header.background;
+    AppendU32(static_cast<uint32_t>(header.width), out);
+    AppendU32(static_cast<uint32_t>(header.height), out);
+    if (padded)
+    {
+        AppendU64(header.data_offset, out);
+        AppendU64(header.stride, out);
+    }
+}
+
+void CanvasCodec::AppendU64(const uint64_t value, std::string& out)
+{
+    AppendU32(static_cast<uint32_t>(value), out);
+    AppendU32(static_cast<uint32_t>(value >> 32), out);
+}
+
+void CanvasCodec::AppendTrailer(const uint64_t index_offset, std::string& out)
+{
+    AppendU64(index_offset, out);
+    out.append(kTrailerMagic, kMagicSize);
+}
+
+void CanvasCodec::AppendRleRow(const char* row, const size_t count, std::string& out)
+{
+    // Пакет пишется прямо в out, длина вставляется перед ним в конце
+    const size_t packet_begin = out.size();
+    size_t literal_begin = 0;
+
+    const auto flush_literal = [&](const size_t literal_end)
+    {
+        while (literal_begin < literal_end)
+        {
+            const size_t size = std::min(literal_end - literal_begin, kMaxLiteral);
+            out += static_cast<char>(size - 1);
+            out.append(row + literal_begin, size);
+            literal_begin += size;
+        }
+    };
+
+    size_t i = 0;
+    while (i < count)
+    {
+        size_t run = 1;
+        while (i + run < count && run < kMaxRun && row[i + run] == row[i])
+        {
+            ++run;
+        }
+
+        if (run >= kMinRun)
+        {
+            flush_literal(i);
+            out += static_cast<char>(run + 125);
+            out += row[i];
+            literal_begin = i + run;
+        }
+        i += run;
+    }
+    flush_literal(count);
+
+    std::string length;
+    AppendVarint(out.size() - packet_begin, length);
+    out.insert(packet_begin, length);
+}
+
+void CanvasCodec::ReadExact(std::istream& is, char* dst, const size_t count)
+{
+    if (!is.read(dst, static_cast<std::streamsize>(count)))
+    {
+        throw std::runtime_error("unexpected end of canvas data");
+    }
+}
+
+CanvasCodec::Header CanvasCodec::ReadHeader(std::istream& is)
+{
+    char bytes[kHeaderSize];
+    std::memcpy(bytes, kMagic, kMagicSize);
+    ReadExact(is, bytes + kMagicSize, kHeaderSize - kMagicSize);
+    if (static_cast<uint8_t>(bytes[4]) != kVersion)
+    {
+        throw std::runtime_error("unsupported canvas file version " +
+                                 std::to_string(static_cast<unsigned char>(bytes[4])));
+    }
+
+    const auto encoding = static_cast<uint8_t>(bytes[5]);
+    if (encoding > static_cast<uint8_t>(Encoding::Rle))
+    {
+        throw std::runtime_error("unknown canvas row encoding " + std::to_string(encoding));
+    }
+
+    Header header{};
+    header.encoding = static_cast<Encoding>(encoding);
+    header.row_index = (static_cast<uint8_t>(bytes[6]) & kRowIndexFlag) != 0;
+    header.background = bytes[7];
+    header.width = CheckedDimension(DecodeLittleEndian(bytes + 8, 4), "width");
+    header.height = CheckedDimension(DecodeLittleEndian(bytes + 12, 4), "height");
+    header.data_offset = kHeaderSize;
+    header.stride = static_cast<uint64_t>(header.width);
+
+    if ((static_cast<uint8_t>(bytes[6]) & kPaddedRowsFlag) != 0)
+    {
+        header.data_offset = ReadU64(is);
+        header.stride = ReadU64(is);
+        if (header.encoding != Encoding::Raw || header.data_offset < kPaddedHeaderSize ||
+            header.stride < static_cast<uint64_t>(header.width))
+        {
+            throw std::runtime_error("invalid padded canvas row layout");
+        }
+    }
+    return header;
+}
+
+uint64_t CanvasCodec::ReadU64(std::istream& is)
+{
+    char bytes[8];
+    ReadExact(is, bytes, sizeof(bytes));
+    return DecodeLittleEndian(bytes, 8);
+}
+
+std::optional<uint64_t> CanvasCodec::ReadTrailer(std::istream& is)
+{
+    char bytes[kTrailerSize];
+    ReadExact(is, bytes, kTrailerSize);
+    if (std::memcmp(bytes + 8, kTrailerMagic, kMagicSize) != 0)
+    {
+        return std::nullopt;
+    }
+    return DecodeLittleEndian(bytes, 8);
+}
+
+uint64_t CanvasCodec::ReadVarint(std::istream& is)
+{
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        const int byte = is.get();
+        if (byte == std::char_traits<char>::eof())
+        {
+            throw std::runtime_error("unexpected end of canvas data");
+        }
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            return value;
+        }
+    }
+    throw std::runtime_error("corrupted canvas row length");
+}
+
+} // namespace plotter
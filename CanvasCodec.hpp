@@ -0,0 +1,116 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+
+namespace plotter
+{
+
+// Двоичный формат холста (все числа little-endian):
+//   заголовок kHeaderSize байт: "ACNV", версия, кодировка, флаги, фон,
+//   ширина и высота (uint32);
+//   строки подряд: Raw - ровно width байт, Rle - varint длины пакета и пакет;
+//   с флагом kRowIndexFlag за строками идут их смещения от конца заголовка
+//   (uint64 на строку) и хвост: смещение индекса от начала записи холста
+//   (ее сигнатуры) и "ACNI";
+//   с флагом kPaddedRowsFlag (только Raw) заголовок продолжают смещение
+//   первой строки от начала файла и шаг строк (uint64): так устроен файл
+//   отображенного холста со строками, выровненными по страницам
+//
+// Пакет строки - PackBits: управляющий байт c < 128 означает c + 1 байт
+// как есть, c >= 128 - повтор следующего байта c - 125 раз
+class CanvasCodec
+{
+public:
+    enum class Encoding : uint8_t
+    {
+        Raw = 0,
+        Rle = 1,
+    };
+
+    struct Header
+    {
+        int width;
+        int height;
+        char background;
+        Encoding encoding;
+        bool row_index;
+        // 0 - строки идут сразу за заголовком и без отступов
+        uint64_t data_offset = 0;
+        uint64_t stride = 0;
+    };
+
+    static constexpr size_t kMagicSize = 4;
+    static constexpr size_t kHeaderSize = 16;
+    static constexpr size_t kPaddedHeaderSize = kHeaderSize + 16;
+    static constexpr size_t kTrailerSize = 12;
+    static constexpr uint8_t kVersion = 1;
+    static constexpr uint8_t kRowIndexFlag = 1;
+    static constexpr uint8_t kPaddedRowsFlag = 2;
+
+    [[nodiscard]] static bool IsBinary(const char* magic) noexcept;
+
+    static void AppendHeader(const Header& header, std::string& out);
+    static void AppendU64(uint64_t value, std::string& out);
+    static void AppendTrailer(uint64_t index_offset, std::string& out);
+    static void AppendRleRow(const char* row, size_t count, std::string& out);
+
+    // Чтение бросает std::runtime_error на обрыве или порче данных.
+    // ReadHeader ждет поток сразу за сигнатурой: ее читает тот, кто выбирает формат.
+    // Поля data_offset и stride прочитанного заголовка всегда заполнены
+    static void ReadExact(std::istream& is, char* dst, size_t count);
+    static Header ReadHeader(std::istream& is);
+    static uint64_t ReadU64(std::istream& is);
+    // Без сигнатуры хвоста - nullopt: за записью холста могут идти другие данные
+    static std::optional<uint64_t> ReadTrailer(std::istream& is);
+    static uint64_t ReadVarint(std::istream& is);
+
+    // Разбирает пакет строки шириной width: literal(x, data, count) для
+    // байт как есть и run(x, value, count) для повторов
+    template <typename Literal, typename Run>
+    static void DecodeRle(const char* packet, size_t size, int width, Literal&& literal, Run&& run);
+};
+
+template <typename Literal, typename Run>
+void CanvasCodec::DecodeRle(const char* packet, const size_t size, const int width, Literal&& literal,
+                            Run&& run)
+{
+    const char* const end = packet + size;
+    int x = 0;
+    while (packet < end)
+    {
+        const auto control = static_cast<unsigned char>(*packet++);
+        if (control < 128)
+        {
+            const int count = control + 1;
+            if (end - packet < count || width - x < count)
+            {
+                throw std::runtime_error("corrupted canvas row: literal overflows the row");
+            }
+            literal(x, packet, count);
+            packet += count;
+            x += count;
+        }
+        else
+        {
+            const int count = control - 125;
+            if (packet == end || width - x < count)
+            {
+                throw std::runtime_error("corrupted canvas row: run overflows the row");
+            }
+            run(x, *packet++, count);
+            x += count;
+        }
+    }
+
+    if (x != width)
+    {
+        throw std::runtime_error("corrupted canvas row: expected " + std::to_string(width) +
+                                 " pixels, got " + std::to_string(x));
+    }
+}
+
+} // namespace plotter
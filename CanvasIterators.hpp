@@ -1,281 +1,261 @@
 #pragma once
 #include "Canvas.hpp"
 #include <cassert>
+#include <compare>
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
 
 namespace plotter
 {
 
-class Canvas::RowIterator
+// Итератор по непрерывному участку буфера (весь холст или одна строка).
+// Границы проверяются только в отладочной сборке, но хранятся всегда:
+// раскладка класса не должна зависеть от NDEBUG в разных единицах трансляции
+template <typename Char>
+class Canvas::ContiguousIterator
 {
 public:
-    RowIterator(Canvas* canvas, int column, int row)
-        : canvas_(canvas), col_(column), row_(row)
-    {
-    }
+    using iterator_concept = std::contiguous_iterator_tag;
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type = std::remove_cv_t<Char>;
+    using difference_type = std::ptrdiff_t;
+    using pointer = Char*;
+    using reference = Char&;
 
-    char operator*() const
+    ContiguousIterator() = default;
+
+    ContiguousIterator(Char* position, Char* first, Char* last) noexcept
+        : position_(position), first_(first), last_(last)
     {
-        return canvas_->at(row_, col_);
     }
 
-    char* operator->() const
+    // Изменяемый итератор приводится к константному
+    template <typename Other, typename = std::enable_if_t<std::is_same_v<Char, const Other>>>
+    ContiguousIterator(const ContiguousIterator<Other>& other) noexcept
+        : ContiguousIterator(other.position_, other.first_, other.last_)
     {
-        return &canvas_->at(row_, col_);
     }
 
-    char operator[](int shift) const
+    reference operator*() const noexcept
     {
-        return canvas_->at(row_, col_ + shift);
+        assert(position_ >= first_ && position_ < last_);
+        return *position_;
     }
 
-    RowIterator operator++()
+    pointer operator->() const noexcept
     {
-        ++col_;
-        return *this;
+        return position_;
     }
 
-    RowIterator operator++(int)
+    reference operator[](const difference_type shift) const noexcept
     {
-        RowIterator tmp = *this;
-        col_++;
-        return tmp;
+        return *(*this + shift);
     }
 
-    RowIterator operator--()
+    ContiguousIterator& operator++() noexcept
     {
-        --col_;
+        ++position_;
         return *this;
     }
 
-    RowIterator operator--(int)
+    ContiguousIterator operator++(int) noexcept
     {
-        RowIterator tmp = *this;
-        col_--;
+        ContiguousIterator tmp = *this;
+        ++position_;
         return tmp;
     }
 
-    RowIterator operator+=(int delta)
+    ContiguousIterator& operator--() noexcept
     {
-        col_ += delta;
+        --position_;
         return *this;
     }
 
-    bool operator==(const RowIterator other) const
-    {
-        return col_ == other.col_ && row_ == other.row_;
-    }
-
-    bool operator!=(const RowIterator other) const
+    ContiguousIterator operator--(int) noexcept
     {
-        return !(*this == other);
-    }
-
-    bool operator<(const RowIterator& other) const
-    {
-        return col_ < other.col_;
-    }
-
-    bool operator<=(const RowIterator& other) const
-    {
-        return !(other < *this);
-    }
-
-    bool operator>(const RowIterator& other) const
-    {
-        return other < *this;
-    }
-
-    bool operator>=(const RowIterator& other) const
-    {
-        return !(*this < other);
+        ContiguousIterator tmp = *this;
+        --position_;
+        return tmp;
     }
 
-private:
-    Canvas* canvas_;
-    int row_;
-    int col_;
-};
-
-class Canvas::ColumnIterator
-{
-public:
-    ColumnIterator(Canvas* canvas, int column, int row)
-        : canvas_(canvas), col_(column), row_(row)
+    ContiguousIterator& operator+=(const difference_type delta) noexcept
     {
+        position_ += delta;
+        return *this;
     }
 
-    char operator*() const
+    ContiguousIterator& operator-=(const difference_type delta) noexcept
     {
-        return canvas_->at(row_, col_);
+        position_ -= delta;
+        return *this;
     }
 
-    char* operator->() const
+    friend ContiguousIterator operator+(ContiguousIterator it, const difference_type delta) noexcept
     {
-        return &canvas_->at(row_, col_);
+        return it += delta;
     }
 
-    char operator[](int shift) const
+    friend ContiguousIterator operator+(const difference_type delta, ContiguousIterator it) noexcept
     {
-        return canvas_->at(row_ + shift, col_);
+        return it += delta;
     }
 
-    ColumnIterator& operator++()
+    friend ContiguousIterator operator-(ContiguousIterator it, const difference_type delta) noexcept
     {
-        ++row_;
-        return *this;
+        return it -= delta;
     }
 
-    ColumnIterator operator++(int)
+    friend difference_type operator-(const ContiguousIterator& lhs, const ContiguousIterator& rhs) noexcept
     {
-        ColumnIterator tmp = *this;
-        row_++;
-        return tmp;
+        return lhs.position_ - rhs.position_;
     }
 
-    ColumnIterator operator--()
+    friend bool operator==(const ContiguousIterator& lhs, const ContiguousIterator& rhs) noexcept
     {
-        --row_;
-        return *this;
+        return lhs.position_ == rhs.position_;
     }
 
-    ColumnIterator operator--(int)
+    friend std::strong_ordering operator<=>(const ContiguousIterator& lhs, const ContiguousIterator& rhs) noexcept
     {
-        ColumnIterator tmp = *this;
-        row_--;
-        return tmp;
+        return std::compare_three_way()(lhs.position_, rhs.position_);
     }
 
-    ColumnIterator operator+=(int delta)
-    {
-        row_ += delta;
-        return *this;
-    }
+private:
+    template <typename>
+    friend class ContiguousIterator;
 
-    bool operator==(const ColumnIterator& other) const
-    {
-        return col_ == other.col_ && row_ == other.row_;
-    }
+    Char* position_ = nullptr;
+    Char* first_ = nullptr;
+    Char* last_ = nullptr;
+};
 
-    bool operator!=(const ColumnIterator& other) const
-    {
-        return !(*this == other);
-    }
+// Итератор по столбцу: шаг равен шагу строк холста, включая отступы
+// строк. Хранит номер строки, а не указатель, чтобы конец столбца не
+// выходил за пределы буфера
+template <typename Char>
+class Canvas::StridedIterator
+{
+public:
+    using iterator_concept = std::random_access_iterator_tag;
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type = std::remove_cv_t<Char>;
+    using difference_type = std::ptrdiff_t;
+    using pointer = Char*;
+    using reference = Char&;
 
-    bool operator<(const ColumnIterator& other) const
-    {
-        return row_ < other.row_;
-    }
+    StridedIterator() = default;
 
-    bool operator<=(const ColumnIterator& other) const
+    StridedIterator(Char* base, const difference_type stride, const difference_type index,
+                    const difference_type count) noexcept
+        : base_(base), stride_(stride), index_(index), count_(count)
     {
-        return !(other < *this);
     }
 
-    bool operator>(const ColumnIterator& other) const
+    template <typename Other, typename = std::enable_if_t<std::is_same_v<Char, const Other>>>
+    StridedIterator(const StridedIterator<Other>& other) noexcept
+        : StridedIterator(other.base_, other.stride_, other.index_, other.count_)
     {
-        return other < *this;
     }
 
-    bool operator>=(const ColumnIterator& other) const
+    reference operator*() const noexcept
     {
-        return !(*this < other);
+        assert(index_ >= 0 && index_ < count_);
+        return base_[index_ * stride_];
     }
 
-private:
-    Canvas* canvas_;
-    int col_;
-    int row_;
-};
-
-class Canvas::PixelIterator
-{
-public:
-    PixelIterator(Canvas* canvas, size_t pos) : canvas_(canvas), pos_(pos)
+    pointer operator->() const noexcept
     {
+        return &**this;
     }
 
-    char& operator*() const
+    reference operator[](const difference_type shift) const noexcept
     {
-        return canvas_->data_.at(pos_);
+        return *(*this + shift);
     }
 
-    char* operator->() const
+    StridedIterator& operator++() noexcept
     {
-        return &canvas_->data_.at(pos_);
+        ++index_;
+        return *this;
     }
 
-    char& operator[](int shift) const
+    StridedIterator operator++(int) noexcept
     {
-        size_t idx = pos_ + shift;
-        assert(idx >= 0 && idx < canvas_->Size());
-        return canvas_->data_[idx];
+        StridedIterator tmp = *this;
+        ++index_;
+        return tmp;
     }
 
-    PixelIterator& operator++()
+    StridedIterator& operator--() noexcept
     {
-        ++pos_;
+        --index_;
         return *this;
     }
 
-    PixelIterator operator++(int)
+    StridedIterator operator--(int) noexcept
     {
-        PixelIterator tmp = *this;
-        pos_++;
+        StridedIterator tmp = *this;
+        --index_;
         return tmp;
     }
 
-    PixelIterator& operator--()
+    StridedIterator& operator+=(const difference_type delta) noexcept
     {
-        --pos_;
+        index_ += delta;
         return *this;
     }
 
-    PixelIterator operator--(int)
+    StridedIterator& operator-=(const difference_type delta) noexcept
     {
-        PixelIterator tmp = *this;
-        pos_--;
-        return tmp;
-    }
-
-    PixelIterator operator+=(int delta)
-    {
-        pos_ += delta;
+        index_ -= delta;
         return *this;
     }
 
-    bool operator==(const PixelIterator& other) const
+    friend StridedIterator operator+(StridedIterator it, const difference_type delta) noexcept
     {
-        return pos_ == other.pos_;
+        return it += delta;
     }
 
-    bool operator!=(const PixelIterator& other) const
+    friend StridedIterator operator+(const difference_type delta, StridedIterator it) noexcept
     {
-        return !(*this == other);
+        return it += delta;
     }
 
-    bool operator<(const PixelIterator& other) const
+    friend StridedIterator operator-(StridedIterator it, const difference_type delta) noexcept
     {
-        return pos_ < other.pos_;
+        return it -= delta;
     }
 
-    bool operator<=(const PixelIterator& other) const
+    friend difference_type operator-(const StridedIterator& lhs, const StridedIterator& rhs) noexcept
     {
-        return !(other < *this);
+        return lhs.index_ - rhs.index_;
     }
 
-    bool operator>(const PixelIterator& other) const
+    friend bool operator==(const StridedIterator& lhs, const StridedIterator& rhs) noexcept
     {
-        return other < *this;
+        return lhs.index_ == rhs.index_ && lhs.base_ == rhs.base_;
     }
 
-    bool operator>=(const PixelIterator& other) const
+    friend std::strong_ordering operator<=>(const StridedIterator& lhs, const StridedIterator& rhs) noexcept
     {
-        return !(*this < other);
+        return lhs.index_ <=> rhs.index_;
     }
 
 private:
-    Canvas* canvas_;
-    size_t pos_;
+    template <typename>
+    friend class StridedIterator;
+
+    Char* base_ = nullptr;
+    difference_type stride_ = 0;
+    difference_type index_ = 0;
+    difference_type count_ = 0;
 };
 
-} // namespace plotter
\ No newline at end of file
+static_assert(std::contiguous_iterator<Canvas::PixelIterator>);
+static_assert(std::contiguous_iterator<Canvas::ConstPixelIterator>);
+static_assert(std::contiguous_iterator<Canvas::RowIterator>);
+static_assert(std::random_access_iterator<Canvas::ColumnIterator>);
+static_assert(std::random_access_iterator<Canvas::ConstColumnIterator>);
+
+} // namespace plotter
@@ -0,0 +1,169 @@
+#include "CanvasJournal.hpp"
+#include <stdexcept>
+#include <utility>
+
+namespace plotter
+{
+
+CanvasJournal::CanvasJournal(const Canvas& canvas, const size_t max_steps)
+    : shadow_(canvas.Snapshot()), max_steps_(max_steps)
+{
+    Remember(canvas);
+}
+
+bool CanvasJournal::Commit(const Canvas& canvas)
+{
+    std::vector<Canvas::DirtySpan> spans;
+    if (&canvas == canvas_ && canvas.Width() == shadow_.Width() && canvas.Height() == shadow_.Height())
+    {
+        if (canvas.Revision() == revision_)
+        {
+            return false;
+        }
+
+        std::vector<int> rows;
+        for (int y = 0; y < canvas.Height(); ++y)
+        {
+            if (canvas.RowRevision(y) != row_revisions_[y])
+            {
+                rows.push_back(y);
+            }
+        }
+        spans = canvas.Diff(shadow_, rows, kMaxSpanGap);
+    }
+    else
+    {
+        spans = canvas.Diff(shadow_, kMaxSpanGap);
+    }
+
+    if (spans.empty())
+    {
+        Remember(canvas);
+        return false;
+    }
+
+    Step step;
+    step.reserve(spans.size());
+    for (const auto& [y, x_begin, x_end] : spans)
+    {
+        const int count = x_end - x_begin + 1;
+        Span& span = step.emplace_back(Span{y, x_begin, std::string(count, '\0'), std::string(count, '\0')});
+        shadow_.ReadRow(x_begin, y, count, span.before.data());
+        canvas.ReadRow(x_begin, y, count, span.after.data());
+    }
+
+    // Плиточный снимок дешевле взять заново: он снова разделит плитки с холстом
+    if (canvas.IsTiled())
+    {
+        shadow_ = canvas.Snapshot();
+    }
+    else
+    {
+        for (const Span& span : step)
+        {
+            shadow_.WriteRow(span.x, span.y, static_cast<int>(span.after.size()), span.after.data());
+        }
+    }
+    Remember(canvas);
+
+    undo_.push_back(std::move(step));
+    if (max_steps_ != 0 && undo_.size() > max_steps_)
+    {
+        undo_.pop_front();
+    }
+    redo_.clear();
+    return true;
+}
+
+bool CanvasJournal::Undo(Canvas& canvas)
+{
+    Commit(canvas);
+    if (undo_.empty())
+    {
+        return false;
+    }
+
+    Apply(undo_.back(), false, canvas);
+    redo_.push_back(std::move(undo_.back()));
+    undo_.pop_back();
+    return true;
+}
+
+bool CanvasJournal::Redo(Canvas& canvas)
+{
+    // Незафиксированная правка после undo обрывает ветку redo
+    if (Commit(canvas) || redo_.empty())
+    {
+        return false;
+    }
+
+    Apply(redo_.back(), true, canvas);
+    undo_.push_back(std::move(redo_.back()));
+    redo_.pop_back();
+    return true;
+}
+
+[[nodiscard]] size_t CanvasJournal::MemoryUsage() const noexcept
+{
+    const auto step_bytes = [](const Step& step)
+    {
+        size_t total = sizeof(Step) + step.capacity() * sizeof(Span);
+        for (const Span& span : step)
+        {
+            total += span.before.capacity() + span.after.capacity();
+        }
+        return total;
+    };
+
+    size_t bytes = 0;
+    for (const Step& step : undo_)
+    {
+        bytes += step_bytes(step);
+    }
+    for (const Step& step : redo_)
+    {
+        bytes += step_bytes(step);
+    }
+    return bytes;
+}
+
+void CanvasJournal::Apply(const Step& step, const bool forward, Canvas& canvas)
+{
+    if (canvas.Width() != shadow_.Width() || canvas.Height() != shadow_.Height())
+    {
+        throw std::invalid_argument("canvas does not match the journal");
+    }
+
+    for (const Span& span : step)
+    {
+        const std::string& pixels = forward ? span.after : span.before;
+        canvas.WriteRow(span.x, span.y, static_cast<int>(pixels.size()), pixels.data());
+    }
+
+    if (canvas.IsTiled())
+    {
+        shadow_ = canvas.Snapshot();
+    }
+    else
+    {
+        for (const Span& span : step)
+        {
+            const std::string& pixels = forward ? span.after : span.before;
+            shadow_.WriteRow(span.x, span.y, static_cast<int>(pixels.size()), pixels.data());
+        }
+    }
+    Remember(canvas);
+}
+
+void CanvasJournal::Remember(const Canvas& canvas)
+{
+    canvas_ = &canvas;
+    revision_ = canvas.Revision();
+    row_revisions_.resize(canvas.Height());
+    for (int y = 0; y < canvas.Height(); ++y)
+    {
+        row_revisions_[y] = canvas.RowRevision(y);
+    }
+}
+
+} // namespace plotter
@@ -0,0 +1,68 @@
+#pragma once
+#include "Canvas.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace plotter
+{
+
+// История правок холста для undo/redo. Шаг хранит только измененные
+// отрезки строк (до и после), а не копию холста: изменения находятся
+// сравнением с теневым снимком на момент прошлой фиксации, причем
+// сравниваются только строки, у которых сменился RowRevision, а нетронутый
+// холст проверяется за O(1). Поэтому запись в холст должна быть видна
+// отслеживанию изменений: после записи через Data() нужен MarkDirty.
+// У плиточного холста снимок делит с ним нетронутые плитки. У плотного
+// снимок - полная копия буфера, которая делается один раз в конструкторе
+// и потом правится отрезками шагов
+class CanvasJournal
+{
+public:
+    // max_steps ограничивает глубину undo; 0 - без ограничения
+    explicit CanvasJournal(const Canvas& canvas, size_t max_steps = 0);
+
+    // Записывает изменения холста с прошлой фиксации одним шагом и очищает
+    // redo. Возвращает false, если холст не менялся. Холст другого размера -
+    // std::invalid_argument
+    bool Commit(const Canvas& canvas);
+    // Незафиксированные изменения сначала становятся отдельным шагом.
+    // false - отменять или повторять нечего
+    bool Undo(Canvas& canvas);
+    bool Redo(Canvas& canvas);
+
+    [[nodiscard]] size_t UndoSteps() const noexcept { return undo_.size(); }
+    [[nodiscard]] size_t RedoSteps() const noexcept { return redo_.size(); }
+    // Байты, занятые шагами истории (без теневого снимка)
+    [[nodiscard]] size_t MemoryUsage() const noexcept;
+
+private:
+    struct Span
+    {
+        int y;
+        int x;
+        std::string before;
+        std::string after;
+    };
+    using Step = std::vector<Span>;
+
+    // Совпадающие пиксели между изменениями короче этого разрыва дешевле
+    // сохранить в отрезке, чем завести новый
+    static constexpr int kMaxSpanGap = 8;
+
+    Canvas shadow_;
+    // Холст и его номера правок, с которыми совпадает снимок
+    const Canvas* canvas_ = nullptr;
+    uint64_t revision_ = 0;
+    std::vector<uint64_t> row_revisions_;
+    size_t max_steps_;
+    std::deque<Step> undo_;
+    std::vector<Step> redo_;
+
+    void Apply(const Step& step, bool forward, Canvas& canvas);
+    void Remember(const Canvas& canvas);
+};
+
+} // namespace plotter
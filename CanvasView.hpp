@@ -0,0 +1,113 @@
+#pragma once
+#include "Rasterizer.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <span>
+#include <type_traits>
+
+namespace plotter
+{
+
+// Невладеющее окно в непрерывный буфер холста: начало, размеры и шаг строки.
+// Живет не дольше холста и не переживает смену его хранения
+template <typename Char>
+class BasicCanvasView
+{
+public:
+    BasicCanvasView() = default;
+
+    BasicCanvasView(Char* origin, const int width, const int height, const ptrdiff_t stride) noexcept
+        : origin_(origin), width_(std::max(width, 0)), height_(std::max(height, 0)), stride_(stride)
+    {
+    }
+
+    // Изменяемое окно приводится к константному
+    template <typename Other, typename = std::enable_if_t<std::is_same_v<Char, const Other>>>
+    BasicCanvasView(const BasicCanvasView<Other>& other) noexcept
+        : BasicCanvasView(other.Row(0), other.Width(), other.Height(), other.Stride())
+    {
+    }
+
+    [[nodiscard]] int Width() const noexcept { return width_; }
+    [[nodiscard]] int Height() const noexcept { return height_; }
+    [[nodiscard]] ptrdiff_t Stride() const noexcept { return stride_; }
+    [[nodiscard]] bool Empty() const noexcept { return width_ == 0 || height_ == 0; }
+
+    [[nodiscard]] Char* Row(const int y) const noexcept { return origin_ + y * stride_; }
+    [[nodiscard]] Char& operator()(const int x, const int y) const noexcept { return Row(y)[x]; }
+    [[nodiscard]] std::span<Char> RowSpan(const int y) const noexcept
+    {
+        return { Row(y), static_cast<size_t>(width_) };
+    }
+
+    [[nodiscard]] bool InBounds(const int x, const int y) const noexcept
+    {
+        return x >= 0 && x < width_ && y >= 0 && y < height_;
+    }
+
+    // Подокно, обрезанное по границам текущего
+    [[nodiscard]] BasicCanvasView SubView(int x, int y, int width, int height) const noexcept
+    {
+        const int left = std::clamp(x, 0, width_);
+        const int top = std::clamp(y, 0, height_);
+        const int right = std::clamp(x + width, left, width_);
+        const int bottom = std::clamp(y + height, top, height_);
+        if (left == right || top == bottom)
+        {
+            return {};
+        }
+        return { Row(top) + left, right - left, bottom - top, stride_ };
+    }
+
+    [[nodiscard]] Rasterizer::ClipRect Clip() const noexcept
+    {
+        return { 0, 0, width_ - 1, height_ - 1 };
+    }
+
+    void Fill(const char fill_char) const
+    {
+        for (int y = 0; y < height_; ++y)
+        {
+            std::memset(Row(y), fill_char, width_);
+        }
+    }
+
+    // Копирует source в левый верхний угол окна построчно; лишнее отбрасывается
+    void CopyFrom(const BasicCanvasView<const char>& source) const
+    {
+        const int width = std::min(width_, source.Width());
+        const int height = std::min(height_, source.Height());
+        for (int y = 0; y < height; ++y)
+        {
+            std::memmove(Row(y), source.Row(y), width);
+        }
+    }
+
+    // Кисть для Rasterizer: рисует примитивы прямо в окно
+    struct Brush
+    {
+        BasicCanvasView view;
+        char brush;
+
+        void operator()(const int x, const int y) const { view(x, y) = brush; }
+
+        void operator()(const int y, const int x_begin, const int x_end) const
+        {
+            std::memset(view.Row(y) + x_begin, brush, x_end - x_begin + 1);
+        }
+    };
+
+    [[nodiscard]] Brush MakeBrush(const char brush) const noexcept { return { *this, brush }; }
+
+private:
+    Char* origin_ = nullptr;
+    int width_ = 0;
+    int height_ = 0;
+    ptrdiff_t stride_ = 0;
+};
+
+using CanvasView = BasicCanvasView<char>;
+using ConstCanvasView = BasicCanvasView<const char>;
+
+} // namespace plotter
@@ -56,6 +56,18 @@ PlotterConfig Config::LoadFromString(std::istream& json_str)
         cfg.plotter_type = type_node->second.AsString();
     }
 
+    if (const auto threads_node = cfg_dict.find("thread_count");
+        threads_node != cfg_dict.end())
+    {
+        cfg.thread_count = threads_node->second.AsInt();
+    }
+
+    if (const auto storage_node = cfg_dict.find("storage");
+        storage_node != cfg_dict.end())
+    {
+        cfg.storage = storage_node->second.AsString();
+    }
+
     if (!ValidateConfig(cfg))
     {
         throw std::invalid_argument("invalid config");
@@ -66,7 +78,11 @@ PlotterConfig Config::LoadFromString(std::istream& json_str)
 
 bool Config::ValidateConfig(const PlotterConfig& config)
 {
-    if (config.width < 0 || config.height < 0 || config.palette.empty())
+    if (config.width < 0 || config.height < 0 || config.palette.empty() || config.thread_count < 0)
+    {
+        return false;
+    }
+    if (config.storage != "dense" && config.storage != "tiled")
     {
         return false;
     }
@@ -81,6 +97,8 @@ PlotterConfig Config::DefaultConfig()
         .background_char = '.',
         .palette = {' ', '.', ':', '-', '=', '+', '*', '#', '%', '@'},
         .plotter_type = "grayscale",
+        .thread_count = 1,
+        .storage = "dense",
     };
 }
 
@@ -13,6 +13,8 @@ struct PlotterConfig
     char background_char;
     std::vector<char> palette;
     std::string plotter_type; // "basic" или "grayscale"
+    int thread_count; // 0 - по числу аппаратных потоков, меньше 0 - ошибка
+    std::string storage; // "dense" или "tiled"
 };
 
 class Config
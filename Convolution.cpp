@@ -0,0 +1,231 @@
+#include "Convolution.hpp"
+#include "SimdKernels.hpp"
+#include "ThreadPool.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+namespace plotter
+{
+
+void Convolution::Separable(std::vector<double>& plane, const int width, const int height, const Kernel& kernel,
+    ThreadPool* pool)
+{
+    const int kernel_size = static_cast<int>(kernel.size());
+    if (kernel_size < 1 || kernel_size % 2 == 0)
+    {
+        throw std::invalid_argument("Kernel size must be odd");
+    }
+
+    const int offset = kernel_size / 2;
+    std::vector<double> horizontal(plane.size());
+
+    // Горизонтальный проход по строкам, дополненным отраженными краями
+    ThreadPool::ForEachBand(pool, height, 1, [&](const int y_begin, const int y_end)
+    {
+        std::vector<double> padded;
+        for (int y = y_begin; y < y_end; ++y)
+        {
+            PadRow(plane.data() + static_cast<size_t>(y) * width, width, offset, padded);
+            SimdKernels::Correlate(padded.data(), kernel.data(), kernel_size,
+                horizontal.data() + static_cast<size_t>(y) * width, width);
+        }
+    });
+
+    // Вертикальный проход: строка результата - взвешенная сумма целых строк;
+    // соседние строки полосы читаются из уже готового горизонтального прохода
+    const auto rows = ReflectedRows(height, offset);
+    ThreadPool::ForEachBand(pool, height, 1, [&](const int y_begin, const int y_end)
+    {
+        for (int y = y_begin; y < y_end; ++y)
+        {
+            double* out = plane.data() + static_cast<size_t>(y) * width;
+            std::fill(out, out + width, 0.0);
+            for (int k = 0; k < kernel_size; ++k)
+            {
+                const int src_y = rows[y + k];
+                if (src_y < 0)
+                    continue;
+
+                SimdKernels::MultiplyAdd(horizontal.data() + static_cast<size_t>(src_y) * width, kernel[k], out, width);
+            }
+            SimdKernels::ScaleClamp(out, 1.0, out, width);
+        }
+    });
+}
+
+void Convolution::Direct(std::vector<double>& plane, const int width, const int height, const Kernel& kernel,
+    ThreadPool* pool)
+{
+    const int kernel_size = static_cast<int>(kernel.size());
+    if (kernel_size < 1 || kernel_size % 2 == 0)
+    {
+        throw std::invalid_argument("Kernel size must be odd");
+    }
+
+    // Плоскость с отраженными краями: внутренний цикл обходится без ветвлений
+    const int offset = kernel_size / 2;
+    const int padded_width = width + 2 * offset;
+    const auto rows = ReflectedRows(height, offset);
+    std::vector<double> padded(static_cast<size_t>(padded_width) * rows.size(), 0.0);
+    ThreadPool::ForEachBand(pool, static_cast<int>(rows.size()), 1, [&](const int py_begin, const int py_end)
+    {
+        std::vector<double> padded_row;
+        for (int py = py_begin; py < py_end; ++py)
+        {
+            if (rows[py] < 0)
+                continue;
+
+            PadRow(plane.data() + static_cast<size_t>(rows[py]) * width, width, offset, padded_row);
+            std::copy(padded_row.begin(), padded_row.end(), padded.begin() + static_cast<size_t>(py) * padded_width);
+        }
+    });
+
+    std::vector<double> weights(static_cast<size_t>(kernel_size) * kernel_size);
+    for (int ky = 0; ky < kernel_size; ++ky)
+    {
+        for (int kx = 0; kx < kernel_size; ++kx)
+        {
+            weights[ky * kernel_size + kx] = kernel[ky] * kernel[kx];
+        }
+    }
+
+    ThreadPool::ForEachBand(pool, height, 1, [&](const int y_begin, const int y_end)
+    {
+        for (int y = y_begin; y < y_end; ++y)
+        {
+            double* out = plane.data() + static_cast<size_t>(y) * width;
+            for (int x = 0; x < width; ++x)
+            {
+                double sum = 0.0;
+                for (int ky = 0; ky < kernel_size; ++ky)
+                {
+                    const double* src = padded.data() + static_cast<size_t>(y + ky) * padded_width + x;
+                    const double* weight = weights.data() + ky * kernel_size;
+                    for (int kx = 0; kx < kernel_size; ++kx)
+                    {
+                        sum += src[kx] * weight[kx];
+                    }
+                }
+                out[x] = sum;
+            }
+            SimdKernels::ScaleClamp(out, 1.0, out, width);
+        }
+    });
+}
+
+void Convolution::Box(std::vector<double>& plane, const int width, const int height, const int kernel_size,
+    ThreadPool* pool)
+{
+    if (kernel_size < 1 || kernel_size % 2 == 0)
+    {
+        throw std::invalid_argument("Kernel size must be odd");
+    }
+
+    const int offset = kernel_size / 2;
+    std::vector<double> horizontal(plane.size());
+
+    // Скользящая сумма по строке; периодически пересчитываем ее заново,
+    // чтобы ошибка округления не накапливалась вдоль длинных строк
+    ThreadPool::ForEachBand(pool, height, 1, [&](const int y_begin, const int y_end)
+    {
+        std::vector<double> padded;
+        for (int y = y_begin; y < y_end; ++y)
+        {
+            PadRow(plane.data() + static_cast<size_t>(y) * width, width, offset, padded);
+            double* out = horizontal.data() + static_cast<size_t>(y) * width;
+            double sum = 0.0;
+            for (int x = 0; x < width; ++x)
+            {
+                if (x % kBoxReseedInterval == 0)
+                {
+                    sum = 0.0;
+                    for (int k = 0; k < kernel_size; ++k)
+                    {
+                        sum += padded[x + k];
+                    }
+                }
+                else
+                {
+                    sum += padded[x + kernel_size - 1] - padded[x - 1];
+                }
+                out[x] = sum;
+            }
+        }
+    });
+
+    // Скользящая сумма строк по вертикали с тем же периодическим пересчетом.
+    // Полосы выровнены по периоду пересчета, поэтому каждая полоса начинает
+    // сумму заново ровно там же, где и последовательный проход
+    const auto rows = ReflectedRows(height, offset);
+    const double scale = 1.0 / (static_cast<double>(kernel_size) * kernel_size);
+    ThreadPool::ForEachBand(pool, height, kBoxReseedInterval, [&](const int y_begin, const int y_end)
+    {
+        std::vector<double> column_sums(width);
+        auto add_row = [&](const int padded_y, const double sign)
+        {
+            const int src_y = rows[padded_y];
+            if (src_y < 0)
+                return;
+
+            SimdKernels::MultiplyAdd(horizontal.data() + static_cast<size_t>(src_y) * width, sign, column_sums.data(), width);
+        };
+
+        for (int y = y_begin; y < y_end; ++y)
+        {
+            if (y % kBoxReseedInterval == 0)
+            {
+                std::fill(column_sums.begin(), column_sums.end(), 0.0);
+                for (int k = 0; k < kernel_size; ++k)
+                {
+                    add_row(y + k, 1.0);
+                }
+            }
+            else
+            {
+                add_row(y + kernel_size - 1, 1.0);
+                add_row(y - 1, -1.0);
+            }
+
+            SimdKernels::ScaleClamp(column_sums.data(), scale, plane.data() + static_cast<size_t>(y) * width, width);
+        }
+    });
+}
+
+int Convolution::Reflect(int index, const int size) noexcept
+{
+    // Обработка границ: отражаем; то, что не попало внутрь, не учитывается
+    if (index < 0)
+    {
+        index = -index;
+    }
+    if (index >= size)
+    {
+        index = 2 * size - index - 1;
+    }
+    return index >= 0 && index < size ? index : -1;
+}
+
+void Convolution::PadRow(const double* row, const int width, const int offset, std::vector<double>& padded)
+{
+    padded.resize(static_cast<size_t>(width) + 2 * offset);
+    for (int i = 0; i < offset; ++i)
+    {
+        const int left = Reflect(i - offset, width);
+        const int right = Reflect(width + i, width);
+        padded[i] = left >= 0 ? row[left] : 0.0;
+        padded[offset + width + i] = right >= 0 ? row[right] : 0.0;
+    }
+    std::copy(row, row + width, padded.begin() + offset);
+}
+
+std::vector<int> Convolution::ReflectedRows(const int height, const int offset)
+{
+    std::vector<int> rows(static_cast<size_t>(height) + 2 * offset);
+    for (int i = 0; i < static_cast<int>(rows.size()); ++i)
+    {
+        rows[i] = Reflect(i - offset, height);
+    }
+    return rows;
+}
+
+} // namespace plotter
\ No newline at end of file
@@ -0,0 +1,29 @@
+#pragma once
+#include <vector>
+
+namespace plotter
+{
+
+class ThreadPool;
+
+class Convolution
+{
+public:
+    using Kernel = std::vector<double>;
+
+    static void Direct(std::vector<double>& plane, int width, int height, const Kernel& kernel,
+        ThreadPool* pool = nullptr);
+    static void Separable(std::vector<double>& plane, int width, int height, const Kernel& kernel,
+        ThreadPool* pool = nullptr);
+    static void Box(std::vector<double>& plane, int width, int height, int kernel_size,
+        ThreadPool* pool = nullptr);
+
+private:
+    static constexpr int kBoxReseedInterval = 64;
+
+    static int Reflect(int index, int size) noexcept;
+    static void PadRow(const double* row, int width, int offset, std::vector<double>& padded);
+    static std::vector<int> ReflectedRows(int height, int offset);
+};
+
+} // namespace plotter
\ No newline at end of file
@@ -1,8 +1,17 @@
 #include "DemoRunner.hpp"
+#include "CanvasIterators.hpp"
+#include "CanvasJournal.hpp"
 #include "PlotterFactory.hpp"
+#include "SharedCanvas.hpp"
+#include "SimdKernels.hpp"
+#include "TerminalRenderer.hpp"
+#include <algorithm>
+#include <cmath>
 #include <fstream>
 #include <iostream>
 #include <chrono>
+#include <random>
+#include <unistd.h>
 
 namespace plotter
 {
@@ -20,6 +29,15 @@ void DemoRunner::RunAllDemos()
     DemoFilters();
     DemoCustomPalettes();
     CompareFillAlgorithms();
+    CompareSimdKernels();
+    CompareTerminalOutput();
+    CompareFileFormats();
+    CompareFrameHandoff();
+    CompareUndoHistory();
+    CompareDeferredRasterization();
+    CompareCommandBuffer();
+    CompareRegionFill();
+    CompareHistogramQueries();
 
     std::cout << "\nВсе демо запущены! Проверь папку Demo, чтобы посмотреть результаты\n";
 }
@@ -182,6 +200,40 @@ void DemoRunner::DemoFilters()
     plotter2.ApplyGaussianBlur(5);
     plotter2.SaveToFile(GetDemoPath("filters_gaussian_blur.txt"));
 
+    // Ошибка свертки не должна терять буфер яркости: отрицательный размер
+    // ядра бросает уже после того, как плоскость яркости взята для свертки
+    GrayscalePlotter buffered(50, 25, ' ');
+    buffered.EnableBrightnessBuffer();
+    buffered.DrawRectangle(10, 5, 25, 15, 0.2, true);
+    buffered.DrawCircle(25, 5, 3, 1.0);
+    bool blur_failed = false;
+    try
+    {
+        buffered.ApplyBoxBlur(-1);
+    }
+    catch (const std::exception&)
+    {
+        blur_failed = true;
+    }
+    buffered.DrawLine(0, 0, 49, 24, 0.5);
+    buffered.ApplyBoxBlur(3);
+    GrayscalePlotter reference(50, 25, ' ');
+    reference.EnableBrightnessBuffer();
+    reference.DrawRectangle(10, 5, 25, 15, 0.2, true);
+    reference.DrawCircle(25, 5, 3, 1.0);
+    reference.DrawLine(0, 0, 49, 24, 0.5);
+    reference.ApplyBoxBlur(3);
+    bool kept = blur_failed;
+    for (int y = 0; y < 25 && kept; ++y)
+    {
+        for (int x = 0; x < 50 && kept; ++x)
+        {
+            kept = std::as_const(buffered.GetCanvas())(x, y) == std::as_const(reference.GetCanvas())(x, y);
+        }
+    }
+    std::ofstream report(GetDemoPath("filters_failed_blur.txt"), std::ios::out | std::ios::trunc);
+    report << "Brightness buffer kept after a failed blur: " << (kept ? "yes" : "no") << "\n";
+
     std::cout << "\tСохраняем результаты в: Demo/filters_*.txt\n";
 }
 
@@ -259,10 +311,847 @@ void DemoRunner::CompareFillAlgorithms()
 
     ss << "\nScanlineFill result:\n";
     plotter2.Render(ss);
+
+    // Большая область: фон холста 2000x1000 вокруг контуров фигур,
+    // затем тысячи мелких заливок клеток сетки подряд
+    constexpr int width = 2000;
+    constexpr int height = 1000;
+    Plotter large_flood(width, height, '.');
+    for (int i = 0; i < 30; ++i)
+    {
+        large_flood.DrawCircle(100 + (i * 397) % (width - 200), 100 + (i * 211) % (height - 200), 20 + i * 3, '#');
+        large_flood.DrawRectangle((i * 149) % width, (i * 83) % height, (i * 149) % width + 40, (i * 83) % height + 25,
+                                  '#');
+    }
+    Plotter large_scanline(std::make_unique<Canvas>(std::as_const(large_flood).GetCanvas()));
+
+    start = std::chrono::high_resolution_clock::now();
+    large_flood.FloodFill(width - 1, height - 1, 'F');
+    end = std::chrono::high_resolution_clock::now();
+    const auto large_flood_time = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+    start = std::chrono::high_resolution_clock::now();
+    large_scanline.ScanlineFill(width - 1, height - 1, 'S');
+    end = std::chrono::high_resolution_clock::now();
+    const auto large_scanline_time = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+    Plotter cells(width, height, ' ');
+    for (int x = 0; x < width; x += 10)
+    {
+        cells.DrawLine(x, 0, x, height - 1, '#');
+    }
+    for (int y = 0; y < height; y += 5)
+    {
+        cells.DrawLine(0, y, width - 1, y, '#');
+    }
+    start = std::chrono::high_resolution_clock::now();
+    int small_fills = 0;
+    for (int y = 2; y < height; y += 5)
+    {
+        for (int x = 5; x < width; x += 10)
+        {
+            cells.ScanlineFill(x, y, 'o');
+            ++small_fills;
+        }
+    }
+    end = std::chrono::high_resolution_clock::now();
+    const auto small_time = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+    const auto flood_pixels = std::ranges::count(std::as_const(large_flood).GetCanvas().Pixels(), 'F');
+    const auto scanline_pixels = std::ranges::count(std::as_const(large_scanline).GetCanvas().Pixels(), 'S');
+    ss << "\nLarge region on " << width << "x" << height << ": " << scanline_pixels << " pixels\n";
+    ss << "FloodFill time: " << large_flood_time << " microseconds\n";
+    ss << "ScanlineFill time: " << large_scanline_time << " microseconds\n";
+    ss << "Speed ratio: " << static_cast<double>(large_flood_time) / static_cast<double>(large_scanline_time)
+       << "x\n";
+    ss << "Same region: " << (flood_pixels == scanline_pixels ? "yes" : "no") << "\n";
+    ss << "ScanlineFill of " << small_fills << " small cells: " << small_time << " microseconds\n";
     const auto filename = GetDemoPath("scanline_benchmark.txt");
     std::ofstream output(filename, std::ios::out | std::ios::trunc);
     output << ss.str();
     std::cout << "\tСохраняем результат в: Demo/scanline_benchmark.txt";
 }
 
-} // namespace plotter
\ No newline at end of file
+void DemoRunner::CompareSimdKernels()
+{
+    std::cout << "\nЗапускаем демо сравнения SIMD ядер со скалярными...\n";
+
+    constexpr size_t count = 1 << 20;
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<double> brightness(-0.25, 1.25);
+    std::uniform_int_distribution<int> byte(0, 255);
+
+    std::vector<double> levels(count + 8);
+    std::vector<char> chars(count);
+    for (auto& level : levels)
+        level = brightness(rng);
+    for (auto& c : chars)
+        c = static_cast<char>(byte(rng));
+
+    std::vector<double> table(256);
+    std::vector<char> remap(256);
+    for (int i = 0; i < 256; ++i)
+    {
+        table[i] = brightness(rng);
+        remap[i] = static_cast<char>(byte(rng));
+    }
+    const std::vector<char> palette = { ' ', '.', ':', '-', '=', '+', '*', '#', '%', '@' };
+    const std::vector<double> kernel = { 0.05, 0.2, 0.5, 0.2, 0.05 };
+
+    struct Output
+    {
+        std::vector<double> doubles;
+        std::vector<char> chars;
+        long long microseconds;
+    };
+
+    auto run = [&](const std::string& name, auto kernel_call)
+    {
+        auto measure = [&](const SimdKernels::Level level)
+        {
+            SimdKernels::SetActiveLevel(level);
+            Output output{ std::vector<double>(count), chars, 0 };
+            const auto start = std::chrono::high_resolution_clock::now();
+            kernel_call(output);
+            const auto end = std::chrono::high_resolution_clock::now();
+            output.microseconds = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+            return output;
+        };
+
+        const auto reference = measure(SimdKernels::Level::Scalar);
+        const auto vectorized = measure(SimdKernels::DetectedLevel());
+
+        double max_error = 0.0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            max_error = std::max(max_error, std::abs(reference.doubles[i] - vectorized.doubles[i]));
+        }
+        const bool chars_equal = reference.chars == vectorized.chars;
+
+        std::stringstream ss;
+        ss << name << ": scalar " << reference.microseconds << " us, "
+           << SimdKernels::LevelName(SimdKernels::DetectedLevel()) << ' ' << vectorized.microseconds << " us, "
+           << "max error " << max_error << ", chars " << (chars_equal ? "equal" : "DIFFERENT") << '\n';
+        return ss.str();
+    };
+
+    std::stringstream ss;
+    ss << "Detected level: " << SimdKernels::LevelName(SimdKernels::DetectedLevel()) << "\n";
+    ss << run("Correlate", [&](Output& out)
+        { SimdKernels::Correlate(levels.data(), kernel.data(), kernel.size(), out.doubles.data(), count); });
+    ss << run("MultiplyAdd", [&](Output& out)
+        { SimdKernels::MultiplyAdd(levels.data(), 0.3, out.doubles.data(), count); });
+    ss << run("ScaleClamp", [&](Output& out)
+        { SimdKernels::ScaleClamp(levels.data(), 1.3, out.doubles.data(), count); });
+    ss << run("Threshold", [&](Output& out)
+        {
+            std::copy(levels.begin(), levels.begin() + count, out.doubles.begin());
+            SimdKernels::Threshold(out.doubles.data(), 0.5, count);
+        });
+    ss << run("Invert", [&](Output& out)
+        {
+            std::copy(levels.begin(), levels.begin() + count, out.doubles.begin());
+            SimdKernels::Invert(out.doubles.data(), count);
+        });
+    ss << run("RemapBytes", [&](Output& out)
+        { SimdKernels::RemapBytes(remap.data(), out.chars.data(), count); });
+    ss << run("DecodeLevels", [&](Output& out)
+        { SimdKernels::DecodeLevels(table.data(), chars.data(), out.doubles.data(), count); });
+    ss << run("QuantizeLevels", [&](Output& out)
+        { SimdKernels::QuantizeLevels(levels.data(), palette.data(), palette.size() - 1, out.chars.data(), count); });
+
+    SimdKernels::SetActiveLevel(SimdKernels::DetectedLevel());
+
+    const auto filename = GetDemoPath("simd_kernels.txt");
+    std::ofstream output(filename, std::ios::out | std::ios::trunc);
+    output << ss.str();
+    std::cout << "\tСохраняем результат в: Demo/simd_kernels.txt";
+}
+
+void DemoRunner::CompareTerminalOutput()
+{
+    std::cout << "\nЗапускаем демо вывода кадров в терминал...\n";
+
+    constexpr int frames = 30;
+    Plotter plotter(200, 60, ' ');
+    std::stringstream terminal_stream;
+    TerminalRenderer terminal(terminal_stream);
+
+    size_t full_bytes = 0;
+    size_t delta_bytes = 0;
+
+    // Шарик летит по экрану поверх неподвижной рамки
+    plotter.DrawRectangle(0, 0, 199, 59, '#');
+    for (int frame = 0; frame < frames; ++frame)
+    {
+        const int x = 20 + frame * 5;
+        const int y = 30 + static_cast<int>(15 * std::sin(frame / 3.0));
+        plotter.DrawCircle(x, y, 6, '@', true);
+
+        std::stringstream full;
+        plotter.Render(full);
+        full_bytes += full.str().size();
+
+        plotter.Present(terminal);
+        delta_bytes += terminal.LastFrameBytes();
+
+        plotter.DrawCircle(x, y, 6, ' ', true);
+    }
+
+    // Ограничение частоты: кадр, пришедший раньше слота, откладывается, и
+    // его заменяет следующий; последний выводит Flush после анимации
+    TerminalRenderer paced(terminal_stream, 30.0);
+    for (int frame = 0; frame < frames; ++frame)
+    {
+        plotter.DrawLine(1, 1 + frame, 198, 1 + frame, '-');
+        plotter.Present(paced);
+    }
+    paced.Flush();
+
+    // Если на экране последний кадр, повторный вывод без ограничения пуст
+    paced.SetTargetFps(0.0);
+    plotter.Present(paced);
+    const bool last_frame_shown = paced.LastFrameBytes() == 0;
+
+    std::stringstream ss;
+    ss << "Frames: " << frames << "\n";
+    ss << "Full repaint bytes: " << full_bytes << "\n";
+    ss << "Delta output bytes: " << delta_bytes << "\n";
+    ss << "Ratio: " << static_cast<double>(full_bytes) / static_cast<double>(delta_bytes) << "x\n";
+    ss << "Paced at 30 fps: presented " << paced.PresentedFrames() - 1 << ", dropped " << paced.DroppedFrames() << "\n";
+    ss << "Last frame on screen after Flush: " << (last_frame_shown ? "yes" : "no") << "\n";
+
+    const auto filename = GetDemoPath("terminal_frames.txt");
+    std::ofstream output(filename, std::ios::out | std::ios::trunc);
+    output << ss.str();
+    std::cout << "\tСохраняем результат в: Demo/terminal_frames.txt";
+}
+
+void DemoRunner::CompareFileFormats()
+{
+    std::cout << "\nЗапускаем демо сравнения форматов файлов холста...\n";
+
+    // Типичный кадр архива: почти весь фон и несколько фигур
+    Plotter plotter(1000, 500, ' ');
+    plotter.DrawRectangle(100, 50, 300, 200, '#');
+    plotter.DrawCircle(600, 250, 80, '*', true);
+    plotter.DrawLine(0, 499, 999, 0, '-');
+    const Canvas& canvas = plotter.GetCanvas();
+
+    struct Format
+    {
+        const char* name;
+        Canvas::FileFormat format;
+        bool row_index;
+    };
+    const std::vector<Format> formats = {
+        { "Text", Canvas::FileFormat::Text, false },
+        { "Binary", Canvas::FileFormat::Binary, false },
+        { "BinaryRle", Canvas::FileFormat::BinaryRle, false },
+        { "BinaryRle + index", Canvas::FileFormat::BinaryRle, true },
+    };
+
+    std::stringstream ss;
+    ss << "Canvas: " << canvas.Width() << "x" << canvas.Height() << "\n";
+    for (const auto& [name, format, row_index] : formats)
+    {
+        std::stringstream file;
+        auto start = std::chrono::high_resolution_clock::now();
+        canvas.Save(file, format, row_index);
+        auto end = std::chrono::high_resolution_clock::now();
+        const auto save_time = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+        const std::string bytes = file.str();
+
+        start = std::chrono::high_resolution_clock::now();
+        const Canvas loaded = Canvas::Load(file);
+        end = std::chrono::high_resolution_clock::now();
+        const auto load_time = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+        std::stringstream band_file(bytes);
+        start = std::chrono::high_resolution_clock::now();
+        const Canvas band = Canvas::LoadRows(band_file, 400, 410);
+        end = std::chrono::high_resolution_clock::now();
+        const auto band_time = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+        ss << name << ": " << bytes.size() << " bytes, "
+           << static_cast<double>(canvas.Size()) / static_cast<double>(bytes.size()) << "x smaller than raw pixels, "
+           << "save " << save_time << " us, load " << load_time << " us, rows 400-409 " << band_time << " us, "
+           << (std::ranges::equal(loaded.Pixels(), canvas.Pixels()) ? "identical" : "MISMATCH") << "\n";
+    }
+
+    // Отображенный холст со строками от границы страницы: между строками
+    // отступы, и итераторы строк и столбцов должны их перешагивать
+    const auto mapped_path = GetDemoPath("padded_canvas.bin");
+    {
+        Canvas padded = Canvas::CreateMapped(mapped_path, canvas.Width(), canvas.Height(), ' ', true);
+        std::vector<char> row(canvas.Width());
+        for (int y = 0; y < canvas.Height(); ++y)
+        {
+            canvas.ReadRow(0, y, canvas.Width(), row.data());
+            padded.WriteRow(0, y, canvas.Width(), row.data());
+        }
+
+        const Canvas& padded_view = padded;
+        bool iterators_match = true;
+        for (int y = 0; y < canvas.Height(); y += 7)
+        {
+            iterators_match = iterators_match
+                && std::equal(padded_view.RowBegin(y), padded_view.RowEnd(y), canvas.RowBegin(y))
+                && std::equal(padded.RowBegin(y), padded.RowEnd(y), canvas.RowBegin(y));
+        }
+        for (int x = 0; x < canvas.Width(); x += 7)
+        {
+            iterators_match = iterators_match
+                && std::equal(padded_view.ColBegin(x), padded_view.ColEnd(x), canvas.ColBegin(x))
+                && std::equal(padded.ColBegin(x), padded.ColEnd(x), canvas.ColBegin(x));
+        }
+        ss << "Page-aligned mapped canvas: row and column iterators "
+           << (iterators_match ? "match" : "MISMATCH") << "\n";
+    }
+    std::filesystem::remove(mapped_path);
+
+    const auto filename = GetDemoPath("file_formats.txt");
+    std::ofstream output(filename, std::ios::out | std::ios::trunc);
+    output << ss.str();
+    std::cout << "\tСохраняем результат в: Demo/file_formats.txt";
+}
+
+void DemoRunner::CompareFrameHandoff()
+{
+    std::cout << "\nЗапускаем демо передачи кадров просмотрщику...\n";
+
+    constexpr int frames = 50;
+    constexpr int width = 400;
+    constexpr int height = 200;
+    const auto handoff_path = GetDemoPath("handoff_frame.txt");
+    const std::string shm_name = "/plotter_demo_" + std::to_string(::getpid());
+
+    // Просмотрщик считает непустые пиксели каждого кадра
+    const auto count_ink = [](const ConstCanvasView& view)
+    {
+        long ink = 0;
+        for (int y = 0; y < view.Height(); ++y)
+        {
+            const auto row = view.RowSpan(y);
+            ink += row.size() - std::count(row.begin(), row.end(), ' ');
+        }
+        return ink;
+    };
+
+    Plotter file_plotter(width, height, ' ');
+    long file_ink = 0;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int frame = 0; frame < frames; ++frame)
+    {
+        file_plotter.DrawCircle(20 + frame * 7, 100, 15, '@', true);
+        file_plotter.SaveToFile(handoff_path);
+        file_ink += count_ink(Canvas::LoadFromFile(handoff_path).View());
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    const auto file_time = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+    std::filesystem::remove(handoff_path);
+
+    auto shared = std::make_unique<Canvas>(Canvas::CreateShared(shm_name, width, height, ' '));
+    Canvas& shared_canvas = *shared;
+    Plotter shared_plotter(std::move(shared));
+    const SharedCanvasReader viewer(shm_name);
+    long shared_ink = 0;
+    start = std::chrono::high_resolution_clock::now();
+    for (int frame = 0; frame < frames; ++frame)
+    {
+        shared_plotter.DrawCircle(20 + frame * 7, 100, 15, '@', true);
+        shared_canvas.PublishFrame();
+        while (!viewer.ReadFrame([&](const ConstCanvasView& view, uint64_t) { shared_ink += count_ink(view); }))
+        {
+        }
+    }
+    end = std::chrono::high_resolution_clock::now();
+    const auto shared_time = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+    std::stringstream ss;
+    ss << "Frames: " << frames << " of " << width << "x" << height << "\n";
+    ss << "SaveToFile + LoadFromFile: " << file_time << " microseconds\n";
+    ss << "Shared memory PublishFrame + ReadFrame: " << shared_time << " microseconds\n";
+    ss << "Speed ratio: " << static_cast<double>(file_time) / static_cast<double>(shared_time) << "x\n";
+    ss << "Viewer saw the same frames: " << (file_ink == shared_ink ? "yes" : "no") << "\n";
+
+    const auto filename = GetDemoPath("frame_handoff.txt");
+    std::ofstream output(filename, std::ios::out | std::ios::trunc);
+    output << ss.str();
+    std::cout << "\tСохраняем результат в: Demo/frame_handoff.txt";
+}
+
+void DemoRunner::CompareUndoHistory()
+{
+    std::cout << "\nЗапускаем демо истории правок...\n";
+
+    constexpr int steps = 200;
+    constexpr int width = 2000;
+    constexpr int height = 1000;
+
+    // Каждая правка - небольшой круг, как мазок кистью в редакторе
+    const auto draw_step = [](Plotter& plotter, const int step)
+    {
+        plotter.DrawCircle(50 + (step * 37) % (width - 100), 50 + (step * 53) % (height - 100), 12,
+                           "#*@o"[step % 4], true);
+    };
+
+    Plotter copy_plotter(width, height, ' ');
+    std::vector<Canvas> copies{ copy_plotter.GetCanvas() };
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int step = 0; step < steps; ++step)
+    {
+        draw_step(copy_plotter, step);
+        copies.push_back(copy_plotter.GetCanvas());
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    const auto copy_time = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+    const size_t copy_bytes = copies.size() * static_cast<size_t>(width) * height;
+
+    Plotter journal_plotter(std::make_unique<Canvas>(width, height, ' ', Canvas::Storage::Tiled));
+    Canvas& canvas = journal_plotter.GetCanvas();
+    CanvasJournal journal(canvas);
+    start = std::chrono::high_resolution_clock::now();
+    for (int step = 0; step < steps; ++step)
+    {
+        draw_step(journal_plotter, step);
+        journal.Commit(canvas);
+    }
+    end = std::chrono::high_resolution_clock::now();
+    const auto journal_time = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+    const size_t journal_bytes = journal.MemoryUsage();
+
+    // Отмена половины шагов должна вернуть тот же холст, что и сохраненная копия
+    for (int step = 0; step < steps / 2; ++step)
+    {
+        journal.Undo(canvas);
+    }
+    const Canvas& expected = copies[steps - steps / 2];
+    // Сравнение читает изменяемый холст: чтение не должно давать правку и дельту журнала
+    canvas.ResetDirty();
+    const uint64_t revision_before_reads = canvas.Revision();
+    bool same = true;
+    for (int y = 0; y < height && same; ++y)
+    {
+        for (int x = 0; x < width && same; ++x)
+        {
+            same = canvas(x, y) == expected(x, y);
+        }
+    }
+    const bool reads_unmarked = canvas.Revision() == revision_before_reads && !canvas.IsDirty();
+
+    std::stringstream ss;
+    ss << "Steps: " << steps << " on " << width << "x" << height << "\n";
+    ss << "Full canvas copies: " << copy_bytes << " bytes, " << copy_time << " microseconds\n";
+    ss << "CanvasJournal deltas: " << journal_bytes << " bytes, " << journal_time << " microseconds\n";
+    ss << "Memory ratio: " << static_cast<double>(copy_bytes) / static_cast<double>(journal_bytes) << "x\n";
+    ss << "Undo restored the saved copy: " << (same ? "yes" : "no") << "\n";
+    ss << "Reads through the mutable canvas left it unchanged: " << (reads_unmarked ? "yes" : "no") << "\n";
+
+    // Плиточный холст не уплотняется сам: изменяемое окно требует MakeDense
+    const size_t tiles = canvas.AllocatedTiles();
+    bool view_refused = false;
+    try
+    {
+        [[maybe_unused]] const CanvasView view = canvas.View();
+    }
+    catch (const std::logic_error&)
+    {
+        view_refused = true;
+    }
+    ss << "Tiled canvas: " << tiles << " tiles with pixels, mutable View "
+       << (view_refused && canvas.IsTiled() && canvas.AllocatedTiles() == tiles ? "refused until MakeDense" : "densified")
+       << "\n";
+
+    const auto filename = GetDemoPath("undo_history.txt");
+    std::ofstream output(filename, std::ios::out | std::ios::trunc);
+    output << ss.str();
+    std::cout << "\tСохраняем результат в: Demo/undo_history.txt";
+}
+
+void DemoRunner::CompareDeferredRasterization()
+{
+    std::cout << "\nЗапускаем демо отложенной растеризации...\n";
+
+    constexpr int primitives = 20000;
+    constexpr int width = 2000;
+    constexpr int height = 1000;
+
+    // Сцена из мелких примитивов, как у генераторов сцен
+    const auto draw_scene = [](Plotter& plotter)
+    {
+        std::mt19937 rng(42);
+        std::uniform_int_distribution<int> x_dist(0, width - 1);
+        std::uniform_int_distribution<int> y_dist(0, height - 1);
+        std::uniform_int_distribution<int> size_dist(2, 40);
+        for (int i = 0; i < primitives; ++i)
+        {
+            const int x = x_dist(rng);
+            const int y = y_dist(rng);
+            const int size = size_dist(rng);
+            const char brush = "#*@o+"[i % 5];
+            switch (i % 4)
+            {
+            case 0:
+                plotter.DrawLine(x, y, x + size * 3, y + size, brush);
+                break;
+            case 1:
+                plotter.DrawRectangle(x, y, x + size, y + size / 2, brush, i % 8 == 1);
+                break;
+            case 2:
+                plotter.DrawTriangle(x, y, x + size, y + size / 3, x + size / 2, y + size, brush, true);
+                break;
+            default:
+                plotter.DrawCircle(x, y, size / 2, brush, i % 8 == 3);
+                break;
+            }
+        }
+    };
+
+    Plotter immediate(width, height, ' ');
+    auto start = std::chrono::high_resolution_clock::now();
+    draw_scene(immediate);
+    auto end = std::chrono::high_resolution_clock::now();
+    const auto immediate_time = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+    Plotter deferred(width, height, ' ');
+    deferred.SetThreadCount(0);
+    deferred.SetDeferred(true);
+    start = std::chrono::high_resolution_clock::now();
+    draw_scene(deferred);
+    deferred.FlushDeferred();
+    end = std::chrono::high_resolution_clock::now();
+    const auto deferred_time = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+    const auto immediate_pixels = immediate.GetCanvas().Pixels();
+    const bool same = std::ranges::equal(immediate_pixels, deferred.GetCanvas().Pixels());
+
+    std::stringstream ss;
+    ss << "Primitives: " << primitives << " on " << width << "x" << height << "\n";
+    ss << "Immediate drawing: " << immediate_time << " microseconds\n";
+    ss << "Deferred tiles on " << deferred.GetThreadCount() << " threads: " << deferred_time << " microseconds\n";
+    ss << "Speed ratio: " << static_cast<double>(immediate_time) / static_cast<double>(deferred_time) << "x\n";
+    ss << "Identical output: " << (same ? "yes" : "no") << "\n";
+
+    // Эллипсы с радиусами в миллионы: на холст попадает только край
+    constexpr int huge_x = 2000000;
+    constexpr int huge_y = 1500000;
+    Plotter huge(200, 100, ' ');
+    huge.DrawEllipse(100, huge_y + 30, huge_x, huge_y, '#', true);
+    huge.DrawEllipse(-huge_x + 150, 50, huge_x, huge_y, '*');
+    bool huge_exact = true;
+    long long outline_pixels = 0;
+    const Canvas& huge_canvas = huge.GetCanvas();
+    for (int y = 0; y < huge_canvas.Height(); ++y)
+    {
+        for (int x = 0; x < huge_canvas.Width(); ++x)
+        {
+            const char pixel = huge_canvas(x, y);
+            if (pixel == '*')
+            {
+                // Точка контура не дальше пикселя от эллипса
+                const double distance = std::hypot(static_cast<double>(x + huge_x - 150) / huge_x,
+                    static_cast<double>(y - 50) / huge_y) - 1.0;
+                huge_exact = huge_exact && std::abs(distance) * huge_x <= 1.0;
+                ++outline_pixels;
+                continue;
+            }
+            const long double dx = static_cast<long double>(x - 100) / huge_x;
+            const long double dy = static_cast<long double>(y - huge_y - 30) / huge_y;
+            const long double value = dx * dx + dy * dy;
+            if (std::abs(value - 1.0L) > 1e-12L)
+            {
+                huge_exact = huge_exact && (pixel == '#') == (value < 1.0L);
+            }
+        }
+    }
+    ss << "Ellipses with radii " << huge_x << " and " << huge_y << " match the exact test: "
+       << (huge_exact && outline_pixels > 0 ? "yes" : "no") << "\n";
+
+    const auto filename = GetDemoPath("deferred_rasterization.txt");
+    std::ofstream output(filename, std::ios::out | std::ios::trunc);
+    output << ss.str();
+    std::cout << "\tСохраняем результат в: Demo/deferred_rasterization.txt";
+}
+
+void DemoRunner::CompareCommandBuffer()
+{
+    std::cout << "\nЗапускаем демо пакета команд рисования...\n";
+
+    constexpr int width = 2000;
+    constexpr int height = 1000;
+    constexpr int cell_width = 16;
+    constexpr int cell_height = 8;
+    constexpr int layers = 4;
+
+    // Карта из клеток в несколько слоев: каждый следующий слой целиком
+    // перекрывает предыдущий, а соседние клетки часто одного цвета
+    DrawCommandBuffer commands;
+    for (int layer = 0; layer < layers; ++layer)
+    {
+        for (int y = 0; y < height; y += cell_height)
+        {
+            for (int x = 0; x < width; x += cell_width)
+            {
+                const char brush = ".:-=+*#%@"[(x / 64 + y / 32 + layer) % 9];
+                commands.Rectangle(x, y, x + cell_width - 1, y + cell_height - 1, brush, true);
+            }
+        }
+    }
+    commands.Circle(width / 2, height / 2, 200, 'O');
+
+    Plotter calls(width, height, ' ');
+    auto start = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < commands.Size(); ++i)
+    {
+        const auto [op, c, values] = commands[i];
+        if (op == DrawCommandBuffer::Op::FilledRectangle)
+        {
+            calls.DrawRectangle(c[0], c[1], c[2], c[3], static_cast<char>(values[0]), true);
+        }
+        else
+        {
+            calls.DrawCircle(c[0], c[1], c[2], static_cast<char>(values[0]));
+        }
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    const auto calls_time = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+    Plotter batched(width, height, ' ');
+    start = std::chrono::high_resolution_clock::now();
+    batched.Submit(commands);
+    end = std::chrono::high_resolution_clock::now();
+    const auto batch_time = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+    const size_t executed = commands.Optimized({ 0, 0, width - 1, height - 1 }).Size();
+    const bool same = std::ranges::equal(calls.GetCanvas().Pixels(), batched.GetCanvas().Pixels());
+
+    std::stringstream ss;
+    ss << "Commands: " << commands.Size() << " on " << width << "x" << height << "\n";
+    ss << "Commands left after culling and merging: " << executed << "\n";
+    ss << "One call per command: " << calls_time << " microseconds\n";
+    ss << "Submit: " << batch_time << " microseconds\n";
+    ss << "Speed ratio: " << static_cast<double>(calls_time) / static_cast<double>(batch_time) << "x\n";
+    ss << "Identical output: " << (same ? "yes" : "no") << "\n";
+
+    const auto filename = GetDemoPath("command_buffer.txt");
+    std::ofstream output(filename, std::ios::out | std::ios::trunc);
+    output << ss.str();
+    std::cout << "\tСохраняем результат в: Demo/command_buffer.txt";
+}
+
+void DemoRunner::CompareRegionFill()
+{
+    std::cout << "\nЗапускаем демо заливки областей по разметке...\n";
+
+    constexpr int width = 2000;
+    constexpr int height = 1000;
+    constexpr int cell_width = 20;
+    constexpr int cell_height = 10;
+
+    // Карта: сетка клеток, которую режут окружности; зерно в центре каждой клетки
+    Plotter calls(width, height, ' ');
+    for (int x = 0; x < width; x += cell_width)
+    {
+        calls.DrawLine(x, 0, x, height - 1, '#');
+    }
+    for (int y = 0; y < height; y += cell_height)
+    {
+        calls.DrawLine(0, y, width - 1, y, '#');
+    }
+    for (int i = 0; i < 40; ++i)
+    {
+        calls.DrawCircle((i * 397) % width, (i * 211) % height, 30 + (i * 53) % 150, '#');
+    }
+    Plotter labelled(std::make_unique<Canvas>(std::as_const(calls).GetCanvas()));
+    labelled.SetThreadCount(0);
+
+    std::vector<std::pair<int, int>> seeds;
+    for (int y = cell_height / 2; y < height; y += cell_height)
+    {
+        for (int x = cell_width / 2; x < width; x += cell_width)
+        {
+            seeds.emplace_back(x, y);
+        }
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (const auto& [x, y] : seeds)
+    {
+        calls.ScanlineFill(x, y, 'o');
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    const auto scanline_time = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+    start = std::chrono::high_resolution_clock::now();
+    const size_t regions = labelled.Regions().RegionCount();
+    end = std::chrono::high_resolution_clock::now();
+    const auto labelling_time = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+    start = std::chrono::high_resolution_clock::now();
+    labelled.FillRegions(seeds, 'o');
+    end = std::chrono::high_resolution_clock::now();
+    const auto fill_time = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+    const bool same = std::ranges::equal(std::as_const(calls).GetCanvas().Pixels(),
+                                         std::as_const(labelled).GetCanvas().Pixels());
+
+    // Все замкнутые области за один вызов: после заливки зерен остались те,
+    // в которые зерна не попали
+    start = std::chrono::high_resolution_clock::now();
+    labelled.FillEnclosedRegions(' ', '.');
+    end = std::chrono::high_resolution_clock::now();
+    const auto enclosed_time = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+    std::stringstream ss;
+    ss << "Seeds: " << seeds.size() << " on " << width << "x" << height << "\n";
+    ss << "Regions: " << regions << "\n";
+    ss << "ScanlineFill per seed: " << scanline_time << " microseconds\n";
+    ss << "FillRegions: " << labelling_time + fill_time << " microseconds (labelling " << labelling_time
+       << ", fill " << fill_time << ")\n";
+    ss << "Speed ratio: " << static_cast<double>(scanline_time) / static_cast<double>(labelling_time + fill_time)
+       << "x\n";
+    ss << "Identical output: " << (same ? "yes" : "no") << "\n";
+    ss << "FillEnclosedRegions after relabelling: " << enclosed_time << " microseconds\n";
+
+    const auto filename = GetDemoPath("region_fill.txt");
+    std::ofstream output(filename, std::ios::out | std::ios::trunc);
+    output << ss.str();
+    std::cout << "\tСохраняем результат в: Demo/region_fill.txt";
+}
+
+void DemoRunner::CompareHistogramQueries()
+{
+    std::cout << "\nЗапускаем демо гистограмм окон по индексу...\n";
+
+    constexpr int width = 2000;
+    constexpr int height = 1000;
+    constexpr int window_width = 16;
+    constexpr int window_height = 8;
+    constexpr int frames = 8;
+
+    // Тепловая карта: каждый кадр меняет несколько строк внизу холста и
+    // запрашивает гистограммы всех окон сетки. Индекс берется раз за кадр
+    Plotter plotter(width, height, ' ');
+    for (int i = 0; i < 60; ++i)
+    {
+        plotter.DrawCircle((i * 397) % width, (i * 211) % height, 20 + (i * 37) % 120, ".:-=+*#%@"[i % 9], true);
+    }
+
+    long long map_time = 0;
+    long long build_time = 0;
+    long long index_time = 0;
+    size_t windows = 0;
+    bool same = true;
+    for (int frame = 0; frame < frames; ++frame)
+    {
+        plotter.DrawLine(0, height - 20 + frame, width - 1, height - 20 + frame, '@');
+
+        auto start = std::chrono::high_resolution_clock::now();
+        std::vector<std::map<char, int>> maps;
+        for (int y = 0; y < height; y += window_height)
+        {
+            for (int x = 0; x < width; x += window_width)
+            {
+                maps.push_back(plotter.ColorHistogram(x, y, x + window_width - 1, y + window_height - 1));
+            }
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        map_time += std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+        start = std::chrono::high_resolution_clock::now();
+        const HistogramIndex& index = plotter.Histograms();
+        const auto refreshed = std::chrono::high_resolution_clock::now();
+        std::vector<HistogramIndex::Counts> counts;
+        counts.reserve(maps.size());
+        for (int y = 0; y < height; y += window_height)
+        {
+            for (int x = 0; x < width; x += window_width)
+            {
+                counts.push_back(index.Histogram(x, y, x + window_width - 1, y + window_height - 1));
+            }
+        }
+        end = std::chrono::high_resolution_clock::now();
+        const auto refresh_time = std::chrono::duration_cast<std::chrono::microseconds>(refreshed - start).count();
+        build_time += frame == 0 ? refresh_time : 0;
+        index_time += std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+        windows += maps.size();
+        for (size_t i = 0; i < maps.size(); ++i)
+        {
+            for (const auto& [color, count] : maps[i])
+            {
+                same = same && counts[i][static_cast<unsigned char>(color)] == static_cast<uint32_t>(count);
+            }
+        }
+    }
+
+    std::stringstream ss;
+    ss << "Windows: " << windows << " (" << window_width << "x" << window_height << ") over " << frames
+       << " frames on " << width << "x" << height << "\n";
+    ss << "Characters indexed: " << plotter.Histograms().Chars().size() << ", index memory: "
+       << plotter.Histograms().MemoryUsage() / 1024 << " KB\n";
+    ss << "ColorHistogram per window: " << map_time << " microseconds\n";
+    ss << "HistogramIndex per window: " << index_time << " microseconds (full build in the first frame: "
+       << build_time << ")\n";
+    ss << "Speed ratio: " << static_cast<double>(map_time) / static_cast<double>(index_time) << "x\n";
+    ss << "Identical counts: " << (same ? "yes" : "no") << "\n";
+
+    // Новый символ у верха холста: пересчитываются только таблицы символов
+    // этой строки, индекс целиком не перестраивается
+    plotter.DrawLine(0, 5, width - 1, 5, '&');
+    auto start = std::chrono::high_resolution_clock::now();
+    const HistogramIndex& index = plotter.Histograms();
+    auto end = std::chrono::high_resolution_clock::now();
+    ss << "New character in row 5: refresh " << std::chrono::duration_cast<std::chrono::microseconds>(end - start).count()
+       << " microseconds, characters indexed: " << index.Chars().size() << "\n";
+
+    // Невыровненные окна от 3x3 до 10x10: каждое стоит O(числа символов)
+    bool unaligned_same = true;
+    for (int size = 3; size <= 10; ++size)
+    {
+        std::vector<std::map<char, int>> maps;
+        start = std::chrono::high_resolution_clock::now();
+        for (int y = 1; y + size <= height; y += size + 1)
+        {
+            for (int x = 1; x + size <= width; x += size + 1)
+            {
+                maps.push_back(plotter.ColorHistogram(x, y, x + size - 1, y + size - 1));
+            }
+        }
+        end = std::chrono::high_resolution_clock::now();
+        const auto unaligned_map_time = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+        std::vector<HistogramIndex::Counts> counts;
+        counts.reserve(maps.size());
+        start = std::chrono::high_resolution_clock::now();
+        for (int y = 1; y + size <= height; y += size + 1)
+        {
+            for (int x = 1; x + size <= width; x += size + 1)
+            {
+                counts.push_back(index.Histogram(x, y, x + size - 1, y + size - 1));
+            }
+        }
+        end = std::chrono::high_resolution_clock::now();
+        const auto unaligned_index_time = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+        for (size_t i = 0; i < maps.size(); ++i)
+        {
+            for (const auto& [color, count] : maps[i])
+            {
+                unaligned_same =
+                    unaligned_same && counts[i][static_cast<unsigned char>(color)] == static_cast<uint32_t>(count);
+            }
+        }
+        ss << "Unaligned " << size << "x" << size << ": " << maps.size() << " windows, ColorHistogram "
+           << unaligned_map_time << " us, HistogramIndex " << unaligned_index_time << " us\n";
+    }
+    ss << "Identical unaligned counts: " << (unaligned_same ? "yes" : "no") << "\n";
+
+    const auto filename = GetDemoPath("histogram_queries.txt");
+    std::ofstream output(filename, std::ios::out | std::ios::trunc);
+    output << ss.str();
+    std::cout << "\tСохраняем результат в: Demo/histogram_queries.txt";
+}
+
+} // namespace plotter
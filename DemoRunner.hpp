@@ -17,6 +17,15 @@ public:
     static void DemoFilters();
     static void DemoCustomPalettes();
     static void CompareFillAlgorithms();
+    static void CompareSimdKernels();
+    static void CompareTerminalOutput();
+    static void CompareFileFormats();
+    static void CompareFrameHandoff();
+    static void CompareUndoHistory();
+    static void CompareDeferredRasterization();
+    static void CompareCommandBuffer();
+    static void CompareRegionFill();
+    static void CompareHistogramQueries();
 
 private:
     static void EnsureDemoDirectory();
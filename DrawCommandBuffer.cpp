@@ -0,0 +1,385 @@
+#include "DrawCommandBuffer.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <tuple>
+
+namespace plotter
+{
+
+namespace
+{
+
+// Число координат и значений у команд в порядке DrawCommandBuffer::Op
+constexpr int kCoordCount[] = { 4, 4, 4, 6, 6, 3, 3, 4, 4, 2, 4, 3, 3 };
+constexpr int kValueCount[] = { 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 0 };
+
+Rasterizer::ClipRect ClipBox(const long long left, const long long top, const long long right,
+                             const long long bottom, const Rasterizer::ClipRect& clip) noexcept
+{
+    return {
+        static_cast<int>(std::max<long long>(left, clip.x_min)),
+        static_cast<int>(std::max<long long>(top, clip.y_min)),
+        static_cast<int>(std::min<long long>(right, clip.x_max)),
+        static_cast<int>(std::min<long long>(bottom, clip.y_max)),
+    };
+}
+
+// Сливает прямоугольники одного цвета: сначала соседей по строке с
+// одинаковыми верхом и низом, затем соседей по столбцу с одинаковыми краями
+void MergeRectangles(std::vector<Rasterizer::ClipRect>& rects)
+{
+    const auto merge = [&rects](auto key, auto same_band, auto touches, auto extend)
+    {
+        std::sort(rects.begin(), rects.end(), [&](const auto& a, const auto& b) { return key(a) < key(b); });
+        size_t merged = 0;
+        for (size_t i = 1; i < rects.size(); ++i)
+        {
+            if (same_band(rects[merged], rects[i]) && touches(rects[merged], rects[i]))
+            {
+                extend(rects[merged], rects[i]);
+            }
+            else
+            {
+                rects[++merged] = rects[i];
+            }
+        }
+        rects.resize(rects.empty() ? 0 : merged + 1);
+    };
+
+    merge([](const auto& r) { return std::tie(r.y_min, r.y_max, r.x_min); },
+          [](const auto& a, const auto& b) { return a.y_min == b.y_min && a.y_max == b.y_max; },
+          [](const auto& a, const auto& b) { return b.x_min <= a.x_max + 1; },
+          [](auto& a, const auto& b) { a.x_max = std::max(a.x_max, b.x_max); });
+    merge([](const auto& r) { return std::tie(r.x_min, r.x_max, r.y_min); },
+          [](const auto& a, const auto& b) { return a.x_min == b.x_min && a.x_max == b.x_max; },
+          [](const auto& a, const auto& b) { return b.y_min <= a.y_max + 1; },
+          [](auto& a, const auto& b) { a.y_max = std::max(a.y_max, b.y_max); });
+}
+
+// Закрашенная поздними заливками часть холста по блокам kBlockSize x kBlockSize.
+// Блок отмечается, только если его целиком накрыла одна заливка, поэтому
+// ответ Covers консервативен: отказ не значит, что команда видна
+class Coverage
+{
+public:
+    static constexpr int kBlockShift = 3;
+    static constexpr int kBlockSize = 1 << kBlockShift;
+
+    explicit Coverage(const Rasterizer::ClipRect& clip)
+        : clip_(clip),
+          blocks_x_(Blocks(clip.x_max - clip.x_min + 1)),
+          blocks_(static_cast<size_t>(blocks_x_) * Blocks(clip.y_max - clip.y_min + 1), false)
+    {
+    }
+
+    void Add(const Rasterizer::ClipRect& rect)
+    {
+        // Блоки, целиком лежащие в rect; край холста считается накрытым
+        const int left = FirstBlock(rect.x_min, clip_.x_min);
+        const int top = FirstBlock(rect.y_min, clip_.y_min);
+        const int right = LastBlock(rect.x_max, clip_.x_min, clip_.x_max);
+        const int bottom = LastBlock(rect.y_max, clip_.y_min, clip_.y_max);
+        for (int y = top; y <= bottom; ++y)
+        {
+            std::fill_n(blocks_.begin() + static_cast<size_t>(y) * blocks_x_ + left, std::max(right - left + 1, 0),
+                        true);
+        }
+        any_ = any_ || (left <= right && top <= bottom);
+    }
+
+    [[nodiscard]] bool Covers(const Rasterizer::ClipRect& rect) const
+    {
+        if (!any_)
+        {
+            return false;
+        }
+
+        const int left = (rect.x_min - clip_.x_min) >> kBlockShift;
+        const int right = (rect.x_max - clip_.x_min) >> kBlockShift;
+        for (int y = (rect.y_min - clip_.y_min) >> kBlockShift; y <= (rect.y_max - clip_.y_min) >> kBlockShift; ++y)
+        {
+            const auto row = blocks_.begin() + static_cast<size_t>(y) * blocks_x_;
+            if (std::find(row + left, row + right + 1, false) != row + right + 1)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void Clear()
+    {
+        if (any_)
+        {
+            std::fill(blocks_.begin(), blocks_.end(), false);
+            any_ = false;
+        }
+    }
+
+private:
+    Rasterizer::ClipRect clip_;
+    int blocks_x_;
+    std::vector<char> blocks_;
+    bool any_ = false;
+
+    static int Blocks(const int size) noexcept
+    {
+        return (std::max(size, 0) + kBlockSize - 1) >> kBlockShift;
+    }
+
+    static int FirstBlock(const int from, const int origin) noexcept
+    {
+        return (from - origin + kBlockSize - 1) >> kBlockShift;
+    }
+
+    static int LastBlock(const int to, const int origin, const int limit) noexcept
+    {
+        return to == limit ? (to - origin) >> kBlockShift : ((to - origin + 1) >> kBlockShift) - 1;
+    }
+};
+
+} // namespace
+
+void DrawCommandBuffer::Line(const int x1, const int y1, const int x2, const int y2, const double value)
+{
+    Append(Op::Line, { x1, y1, x2, y2 }, { value });
+}
+
+void DrawCommandBuffer::Rectangle(const int x1, const int y1, const int x2, const int y2, const double value,
+                                  const bool fill)
+{
+    Append(fill ? Op::FilledRectangle : Op::Rectangle, { x1, y1, x2, y2 }, { value });
+}
+
+void DrawCommandBuffer::Triangle(const int x1, const int y1, const int x2, const int y2, const int x3, const int y3,
+                                 const double value, const bool fill)
+{
+    Append(fill ? Op::FilledTriangle : Op::Triangle, { x1, y1, x2, y2, x3, y3 }, { value });
+}
+
+void DrawCommandBuffer::Circle(const int center_x, const int center_y, const int radius, const double value,
+                               const bool fill)
+{
+    Append(fill ? Op::FilledCircle : Op::Circle, { center_x, center_y, radius }, { value });
+}
+
+void DrawCommandBuffer::Ellipse(const int center_x, const int center_y, const int radius_x, const int radius_y,
+                                const double value, const bool fill)
+{
+    Append(fill ? Op::FilledEllipse : Op::Ellipse, { center_x, center_y, radius_x, radius_y }, { value });
+}
+
+void DrawCommandBuffer::Fill(const int x, const int y, const double value)
+{
+    Append(Op::Fill, { x, y }, { value });
+}
+
+void DrawCommandBuffer::LinearGradient(const int x1, const int y1, const int x2, const int y2,
+                                       const double start_value, const double end_value)
+{
+    Append(Op::LinearGradient, { x1, y1, x2, y2 }, { start_value, end_value });
+}
+
+void DrawCommandBuffer::RadialGradient(const int center_x, const int center_y, const int radius,
+                                       const double center_value, const double edge_value)
+{
+    Append(Op::RadialGradient, { center_x, center_y, radius }, { center_value, edge_value });
+}
+
+void DrawCommandBuffer::Paste(const ConstCanvasView region, const int x, const int y)
+{
+    Append(Op::Paste, { x, y, static_cast<int>(views_.size()) }, {});
+    views_.push_back(region);
+}
+
+void DrawCommandBuffer::Clear() noexcept
+{
+    ops_.clear();
+    first_coord_.clear();
+    first_value_.clear();
+    coords_.clear();
+    values_.clear();
+    views_.clear();
+}
+
+[[nodiscard]] DrawCommandBuffer::Command DrawCommandBuffer::operator[](const size_t index) const noexcept
+{
+    assert(index < ops_.size());
+    return { ops_[index], coords_.data() + first_coord_[index], values_.data() + first_value_[index] };
+}
+
+DrawCommandBuffer DrawCommandBuffer::Optimized(const Rasterizer::ClipRect& clip) const
+{
+    const size_t count = ops_.size();
+    std::vector<Rasterizer::ClipRect> bounds(count);
+    std::vector<char> keep(count, false);
+
+    // С конца: команда не нужна, если ее целиком закрасят более поздние заливки
+    Coverage coverage(clip);
+    for (size_t i = count; i-- > 0;)
+    {
+        bounds[i] = Bounds(i, clip);
+        if (bounds[i].Empty())
+        {
+            continue;
+        }
+        if (ops_[i] == Op::Fill)
+        {
+            keep[i] = true;
+            coverage.Clear();
+            continue;
+        }
+        if (coverage.Covers(bounds[i]))
+        {
+            continue;
+        }
+
+        keep[i] = true;
+        if (ops_[i] == Op::Paste)
+        {
+            coverage.Clear();
+        }
+        else if (ops_[i] == Op::FilledRectangle)
+        {
+            coverage.Add(bounds[i]);
+        }
+    }
+
+    DrawCommandBuffer result;
+    const size_t kept = static_cast<size_t>(std::count(keep.begin(), keep.end(), true));
+    result.ops_.reserve(kept);
+    result.first_coord_.reserve(kept);
+    result.first_value_.reserve(kept);
+    result.coords_.reserve(kept * 4);
+    result.values_.reserve(kept);
+    std::vector<Rasterizer::ClipRect> rects;
+    size_t i = 0;
+    while (i < count)
+    {
+        if (!keep[i])
+        {
+            ++i;
+            continue;
+        }
+        if (!IsShape(ops_[i]))
+        {
+            result.AppendCommand(*this, i);
+            ++i;
+            continue;
+        }
+
+        // Серия фигур с одним значением; выброшенные команды ее не прерывают
+        const double value = values_[first_value_[i]];
+        size_t end = i;
+        rects.clear();
+        for (; end < count; ++end)
+        {
+            if (!keep[end])
+            {
+                continue;
+            }
+            if (!IsShape(ops_[end]) || values_[first_value_[end]] != value)
+            {
+                break;
+            }
+            if (ops_[end] == Op::FilledRectangle)
+            {
+                rects.push_back(bounds[end]);
+            }
+        }
+
+        MergeRectangles(rects);
+        for (const auto& rect : rects)
+        {
+            result.Append(Op::FilledRectangle, { rect.x_min, rect.y_min, rect.x_max, rect.y_max }, { value });
+        }
+        for (; i < end; ++i)
+        {
+            if (keep[i] && ops_[i] != Op::FilledRectangle)
+            {
+                result.AppendCommand(*this, i);
+            }
+        }
+    }
+    return result;
+}
+
+void DrawCommandBuffer::Append(const Op op, const std::initializer_list<int> coords,
+                               const std::initializer_list<double> values)
+{
+    assert(static_cast<int>(coords.size()) == kCoordCount[static_cast<int>(op)]);
+    assert(static_cast<int>(values.size()) == kValueCount[static_cast<int>(op)]);
+    ops_.push_back(op);
+    first_coord_.push_back(static_cast<uint32_t>(coords_.size()));
+    first_value_.push_back(static_cast<uint32_t>(values_.size()));
+    coords_.insert(coords_.end(), coords);
+    values_.insert(values_.end(), values);
+}
+
+void DrawCommandBuffer::AppendCommand(const DrawCommandBuffer& source, const size_t index)
+{
+    const Command command = source[index];
+    const int op = static_cast<int>(command.op);
+    ops_.push_back(command.op);
+    first_coord_.push_back(static_cast<uint32_t>(coords_.size()));
+    first_value_.push_back(static_cast<uint32_t>(values_.size()));
+    coords_.insert(coords_.end(), command.coords, command.coords + kCoordCount[op]);
+    values_.insert(values_.end(), command.values, command.values + kValueCount[op]);
+    if (command.op == Op::Paste)
+    {
+        // Окно переезжает вместе с командой под новым номером
+        coords_.back() = static_cast<int>(views_.size());
+        views_.push_back(source.Source(command));
+    }
+}
+
+[[nodiscard]] bool DrawCommandBuffer::IsShape(const Op op) noexcept
+{
+    return op <= Op::FilledEllipse;
+}
+
+[[nodiscard]] Rasterizer::ClipRect DrawCommandBuffer::Bounds(const size_t index,
+                                                            const Rasterizer::ClipRect& clip) const noexcept
+{
+    const int* c = coords_.data() + first_coord_[index];
+    switch (ops_[index])
+    {
+    case Op::Line:
+    case Op::Rectangle:
+    case Op::FilledRectangle:
+        return ClipBox(std::min(c[0], c[2]), std::min(c[1], c[3]), std::max(c[0], c[2]), std::max(c[1], c[3]), clip);
+    case Op::Triangle:
+    case Op::FilledTriangle:
+        return ClipBox(std::min({ c[0], c[2], c[4] }), std::min({ c[1], c[3], c[5] }),
+                       std::max({ c[0], c[2], c[4] }), std::max({ c[1], c[3], c[5] }), clip);
+    case Op::Circle:
+    case Op::FilledCircle:
+    {
+        // Контур с отрицательным радиусом рисуется как с |radius|, а с нулевым
+        // задевает и соседние пиксели
+        const long long radius = ops_[index] == Op::Circle ? std::max(std::llabs(c[2]), 1LL) : std::llabs(c[2]);
+        return ClipBox(c[0] - radius, c[1] - radius, c[0] + radius, c[1] + radius, clip);
+    }
+    case Op::Ellipse:
+    case Op::FilledEllipse:
+        return ClipBox(static_cast<long long>(c[0]) - c[2], static_cast<long long>(c[1]) - c[3],
+                       static_cast<long long>(c[0]) + c[2], static_cast<long long>(c[1]) + c[3], clip);
+    case Op::Fill:
+        return ClipBox(c[0], c[1], c[0], c[1], clip);
+    case Op::LinearGradient:
+        return ClipBox(c[0], c[1], c[2], c[3], clip);
+    case Op::RadialGradient:
+        return ClipBox(static_cast<long long>(c[0]) - c[2], static_cast<long long>(c[1]) - c[2],
+                       static_cast<long long>(c[0]) + c[2], static_cast<long long>(c[1]) + c[2], clip);
+    case Op::Paste:
+    {
+        const ConstCanvasView& region = views_[c[2]];
+        return ClipBox(c[0], c[1], static_cast<long long>(c[0]) + region.Width() - 1,
+                       static_cast<long long>(c[1]) + region.Height() - 1, clip);
+    }
+    }
+    return { 0, 0, -1, -1 };
+}
+
+} // namespace plotter
@@ -0,0 +1,107 @@
+#pragma once
+#include "CanvasView.hpp"
+#include "Rasterizer.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <vector>
+
+namespace plotter
+{
+
+// Пакет команд рисования в плоском виде (структура массивов): коды команд,
+// их координаты и значения лежат в отдельных непрерывных массивах.
+// Значение - символ кисти для Plotter::Submit или яркость для
+// GrayscalePlotter::Submit. Окна для Paste не копируются: их буферы
+// должны жить до Submit
+class DrawCommandBuffer
+{
+public:
+    enum class Op : uint8_t
+    {
+        Line,
+        Rectangle,
+        FilledRectangle,
+        Triangle,
+        FilledTriangle,
+        Circle,
+        FilledCircle,
+        Ellipse,
+        FilledEllipse,
+        Fill,
+        LinearGradient,
+        RadialGradient,
+        Paste,
+    };
+
+    // Команда, читаемая из пакета: координаты и значения в порядке
+    // аргументов соответствующего метода. У Paste третья координата -
+    // номер окна для Source
+    struct Command
+    {
+        Op op;
+        const int* coords;
+        const double* values;
+    };
+
+    void Line(int x1, int y1, int x2, int y2, double value);
+    void Rectangle(int x1, int y1, int x2, int y2, double value, bool fill = false);
+    void Triangle(int x1, int y1, int x2, int y2, int x3, int y3, double value, bool fill = false);
+    void Circle(int center_x, int center_y, int radius, double value, bool fill = false);
+    void Ellipse(int center_x, int center_y, int radius_x, int radius_y, double value, bool fill = false);
+    // Заливка связной области от точки, как ScanlineFill
+    void Fill(int x, int y, double value);
+    void LinearGradient(int x1, int y1, int x2, int y2, double start_value, double end_value);
+    void RadialGradient(int center_x, int center_y, int radius, double center_value, double edge_value);
+    void Paste(ConstCanvasView region, int x, int y);
+
+    [[nodiscard]] size_t Size() const noexcept { return ops_.size(); }
+    [[nodiscard]] bool Empty() const noexcept { return ops_.empty(); }
+    void Clear() noexcept;
+
+    [[nodiscard]] Command operator[](size_t index) const noexcept;
+    [[nodiscard]] ConstCanvasView Source(const Command& paste) const noexcept { return views_[paste.coords[2]]; }
+
+    // Копия пакета, в которой значение кисти каждой команды (кроме
+    // градиентов) заменено на paint(значение)
+    template <typename Paint>
+    [[nodiscard]] DrawCommandBuffer MapPaint(Paint&& paint) const;
+
+    // Пакет с тем же результатом на холсте с границами clip:
+    // - выброшены команды, не задевающие холст или целиком накрытые более
+    //   поздними заливками прямоугольников (заливка области и вставка читают
+    //   холст, поэтому через них перекрытие не переносится);
+    // - в каждой серии подряд идущих фигур с одним значением порядок не
+    //   важен: ее залитые прямоугольники собраны вперед и смежные слиты
+    [[nodiscard]] DrawCommandBuffer Optimized(const Rasterizer::ClipRect& clip) const;
+
+private:
+    std::vector<Op> ops_;
+    std::vector<uint32_t> first_coord_;
+    std::vector<uint32_t> first_value_;
+    std::vector<int> coords_;
+    std::vector<double> values_;
+    std::vector<ConstCanvasView> views_;
+
+    void Append(Op op, std::initializer_list<int> coords, std::initializer_list<double> values);
+    void AppendCommand(const DrawCommandBuffer& source, size_t index);
+    [[nodiscard]] static bool IsShape(Op op) noexcept;
+    [[nodiscard]] Rasterizer::ClipRect Bounds(size_t index, const Rasterizer::ClipRect& clip) const noexcept;
+};
+
+template <typename Paint>
+DrawCommandBuffer DrawCommandBuffer::MapPaint(Paint&& paint) const
+{
+    DrawCommandBuffer mapped = *this;
+    for (size_t i = 0; i < ops_.size(); ++i)
+    {
+        if (IsShape(ops_[i]) || ops_[i] == Op::Fill)
+        {
+            double& value = mapped.values_[first_value_[i]];
+            value = paint(value);
+        }
+    }
+    return mapped;
+}
+
+} // namespace plotter
@@ -0,0 +1,125 @@
+#include "FillWorkspace.hpp"
+#include "SimdKernels.hpp"
+#include <cstring>
+#include <utility>
+
+namespace plotter
+{
+
+void FillWorkspace::ScanlineFill(Canvas& canvas, const int x, const int y, const char fill_brush)
+{
+    if (!canvas.InBounds(x, y))
+    {
+        return;
+    }
+
+    const int width = canvas.Width();
+    const int height = canvas.Height();
+    const char target_brush = std::as_const(canvas)(x, y);
+    if (target_brush == fill_brush)
+    {
+        return;
+    }
+
+    // Отрезок стека - диапазон строки, в котором ищутся пиксели цели:
+    // найденный отрезок цели продлевается за его края, закрашивается, и
+    // его диапазон передается соседним строкам
+    segments_.clear();
+    segments_.push_back({ y, x, x });
+    row_.resize(canvas.IsTiled() ? width : 0);
+
+    while (!segments_.empty())
+    {
+        const auto [row_y, x_begin, x_end] = segments_.back();
+        segments_.pop_back();
+
+        const char* row = ReadRow(canvas, row_y);
+        int current = x_begin;
+        while (current <= x_end)
+        {
+            const auto* found = static_cast<const char*>(std::memchr(row + current, target_brush, x_end - current + 1));
+            if (!found)
+            {
+                break;
+            }
+
+            const int start = static_cast<int>(found - row);
+            const int left = start - static_cast<int>(SimdKernels::CountTrailing(row, target_brush, start));
+            const int right = start + static_cast<int>(SimdKernels::CountLeading(found, target_brush, width - start)) - 1;
+            canvas.FillRegion(left, row_y, right, row_y, fill_brush);
+
+            if (row_y > 0)
+            {
+                segments_.push_back({ row_y - 1, left, right });
+            }
+            if (row_y < height - 1)
+            {
+                segments_.push_back({ row_y + 1, left, right });
+            }
+            // За right стоит не цель или край строки
+            current = right + 2;
+        }
+    }
+}
+
+void FillWorkspace::FloodFill(Canvas& canvas, const int x, const int y, const char fill_brush)
+{
+    if (!canvas.InBounds(x, y))
+    {
+        return;
+    }
+
+    const char target_brush = std::as_const(canvas)(x, y);
+    if (target_brush == fill_brush)
+    {
+        return;
+    }
+
+    const int width = canvas.Width();
+    const int height = canvas.Height();
+    const auto visit = [&](const int px, const int py)
+    {
+        if (std::as_const(canvas)(px, py) == target_brush)
+        {
+            canvas(px, py) = fill_brush;
+            pixels_.push_back({ px, py });
+        }
+    };
+
+    pixels_.clear();
+    visit(x, y);
+    while (!pixels_.empty())
+    {
+        const auto [px, py] = pixels_.back();
+        pixels_.pop_back();
+
+        if (px + 1 < width)
+        {
+            visit(px + 1, py);
+        }
+        if (px > 0)
+        {
+            visit(px - 1, py);
+        }
+        if (py + 1 < height)
+        {
+            visit(px, py + 1);
+        }
+        if (py > 0)
+        {
+            visit(px, py - 1);
+        }
+    }
+}
+
+const char* FillWorkspace::ReadRow(const Canvas& canvas, const int y)
+{
+    if (!canvas.IsTiled())
+    {
+        return canvas.Row(y).data();
+    }
+    canvas.ReadRow(0, y, canvas.Width(), row_.data());
+    return row_.data();
+}
+
+} // namespace plotter
@@ -0,0 +1,43 @@
+#pragma once
+#include "Canvas.hpp"
+#include <vector>
+
+namespace plotter
+{
+
+// Рабочая память заливок: стеки отрезков и пикселей растут по вектору и
+// переживают вызовы, так что повторные заливки не выделяют память.
+// Пиксель закрашивается в момент добавления в стек, поэтому кисть сама
+// служит отметкой посещения и отдельную карту очищать не нужно
+class FillWorkspace
+{
+public:
+    // Заливка отрезками строк: границы отрезков ищутся по указателю на
+    // строку через memchr и SimdKernels::CountLeading/CountTrailing
+    void ScanlineFill(Canvas& canvas, int x, int y, char fill_brush);
+    // Заливка по пикселям через 4 соседей
+    void FloodFill(Canvas& canvas, int x, int y, char fill_brush);
+
+private:
+    struct Segment
+    {
+        int y;
+        int x_begin;
+        int x_end;
+    };
+
+    struct Pixel
+    {
+        int x;
+        int y;
+    };
+
+    std::vector<Segment> segments_;
+    std::vector<Pixel> pixels_;
+    // Строка плиточного холста: у него нет непрерывного буфера
+    std::vector<char> row_;
+
+    const char* ReadRow(const Canvas& canvas, int y);
+};
+
+} // namespace plotter
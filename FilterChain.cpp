@@ -0,0 +1,77 @@
+#include "FilterChain.hpp"
+#include "SimdKernels.hpp"
+#include <algorithm>
+
+namespace plotter
+{
+
+FilterChain& FilterChain::AdjustBrightness(const double factor)
+{
+    stages_.push_back({StageType::AdjustBrightness, factor, 0});
+    return *this;
+}
+
+FilterChain& FilterChain::Threshold(const double threshold)
+{
+    stages_.push_back({StageType::Threshold, threshold, 0});
+    return *this;
+}
+
+FilterChain& FilterChain::Invert()
+{
+    stages_.push_back({StageType::Invert, 0.0, 0});
+    return *this;
+}
+
+FilterChain& FilterChain::BoxBlur(const int kernel_size)
+{
+    stages_.push_back({StageType::BoxBlur, 0.0, kernel_size});
+    return *this;
+}
+
+FilterChain& FilterChain::GaussianBlur(const int kernel_size)
+{
+    stages_.push_back({StageType::GaussianBlur, 0.0, kernel_size});
+    return *this;
+}
+
+bool FilterChain::IsPointwise(const Stage& stage) noexcept
+{
+    return stage.type == StageType::AdjustBrightness || stage.type == StageType::Threshold ||
+           stage.type == StageType::Invert;
+}
+
+double FilterChain::ApplyPoint(const Stage& stage, const double brightness)
+{
+    switch (stage.type)
+    {
+    case StageType::AdjustBrightness:
+        return std::clamp(brightness * stage.value, 0.0, 1.0);
+    case StageType::Threshold:
+        return brightness >= stage.value ? 1.0 : 0.0;
+    case StageType::Invert:
+        return 1.0 - brightness;
+    default:
+        return brightness;
+    }
+}
+
+void FilterChain::ApplyPoint(const Stage& stage, double* data, const size_t count)
+{
+    switch (stage.type)
+    {
+    case StageType::AdjustBrightness:
+        SimdKernels::ScaleClamp(data, stage.value, data, count);
+        break;
+    case StageType::Threshold:
+        SimdKernels::Threshold(data, stage.value, count);
+        break;
+    case StageType::Invert:
+        SimdKernels::Invert(data, count);
+        break;
+    default:
+        break;
+    }
+}
+
+} // namespace plotter
\ No newline at end of file
@@ -0,0 +1,44 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+namespace plotter
+{
+
+class FilterChain
+{
+public:
+    enum class StageType
+    {
+        AdjustBrightness,
+        Threshold,
+        Invert,
+        BoxBlur,
+        GaussianBlur,
+    };
+
+    struct Stage
+    {
+        StageType type;
+        double value;
+        int kernel_size;
+    };
+
+    FilterChain& AdjustBrightness(double factor);
+    FilterChain& Threshold(double threshold);
+    FilterChain& Invert();
+    FilterChain& BoxBlur(int kernel_size = 3);
+    FilterChain& GaussianBlur(int kernel_size = 3);
+
+    [[nodiscard]] const std::vector<Stage>& Stages() const noexcept { return stages_; }
+    [[nodiscard]] bool Empty() const noexcept { return stages_.empty(); }
+
+    [[nodiscard]] static bool IsPointwise(const Stage& stage) noexcept;
+    [[nodiscard]] static double ApplyPoint(const Stage& stage, double brightness);
+    static void ApplyPoint(const Stage& stage, double* data, size_t count);
+
+private:
+    std::vector<Stage> stages_;
+};
+
+} // namespace plotter
\ No newline at end of file
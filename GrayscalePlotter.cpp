@@ -1,11 +1,37 @@
 #include "GrayscalePlotter.hpp"
 #include "CanvasIterators.hpp"
+#include "SimdKernels.hpp"
+#include "ThreadPool.hpp"
 #include <cmath>
+#include <cstring>
 #include <functional>
+#include <numeric>
+#include <utility>
 
 namespace plotter
 {
 
+struct GrayscalePlotter::BrightnessWriter
+{
+    std::vector<double>& buffer;
+    std::vector<char>& dirty_rows;
+    int width;
+    double brightness;
+
+    void operator()(const int x, const int y) const
+    {
+        buffer[static_cast<size_t>(y) * width + x] = brightness;
+        dirty_rows[y] = true;
+    }
+
+    void operator()(const int y, const int x_begin, const int x_end) const
+    {
+        const auto row = buffer.begin() + static_cast<size_t>(y) * width;
+        std::fill(row + x_begin, row + x_end + 1, brightness);
+        dirty_rows[y] = true;
+    }
+};
+
 std::vector<char> GrayscalePlotter::DefaultPalette()
 {
     return { ' ', '.', ':', '-', '=', '+', '*', '#', '%', '@' };
@@ -13,46 +39,283 @@ std::vector<char> GrayscalePlotter::DefaultPalette()
 
 GrayscalePlotter::GrayscalePlotter(std::unique_ptr<Canvas> canvas, const std::vector<char>& palette) 
 : Plotter(std::move(canvas))
-, palette_(palette) 
+, palette_(palette)
+, lookup_(palette)
 {}
 
 GrayscalePlotter::GrayscalePlotter(int width, int height, char background_char, const std::vector<char>& palette) 
 : Plotter(width, height, background_char)
-, palette_(palette) 
+, palette_(palette)
+, lookup_(palette)
 {}
 
+GrayscalePlotter::~GrayscalePlotter() = default;
+
+GrayscalePlotter::BrightnessWriter GrayscalePlotter::BufferWriter(const double brightness)
+{
+    // Запись в буфер идет после записей символами, сделанных до нее
+    PullCanvasWrites();
+    return { brightness_, dirty_rows_, RawCanvas().Width(), std::clamp(brightness, 0.0, 1.0) };
+}
+
+void GrayscalePlotter::MarkAllRowsDirty()
+{
+    std::fill(dirty_rows_.begin(), dirty_rows_.end(), true);
+}
+
+void GrayscalePlotter::DecodeCanvas(double* dst) const
+{
+    const int width = RawCanvas().Width();
+    ForEachRowBand([&](const int y_begin, const int y_end)
+    {
+        std::vector<char> scratch(RawCanvas().IsTiled() ? width : 0);
+        for (int y = y_begin; y < y_end; ++y)
+        {
+            SimdKernels::DecodeLevels(lookup_.LevelTable(), ReadCanvasRow(y, scratch.data()),
+                dst + static_cast<size_t>(y) * width, width);
+        }
+    });
+}
+
+void GrayscalePlotter::QuantizeCanvas(const double* src) const
+{
+    const int width = RawCanvas().Width();
+    ForEachRowBand([&](const int y_begin, const int y_end)
+    {
+        std::vector<char> scratch(RawCanvas().IsTiled() ? width : 0);
+        for (int y = y_begin; y < y_end; ++y)
+        {
+            StoreCanvasRow(y, src + static_cast<size_t>(y) * width, scratch.data());
+        }
+    });
+}
+
+const char* GrayscalePlotter::ReadCanvasRow(const int y, char* scratch) const
+{
+    const Canvas& canvas = RawCanvas();
+    if (!canvas.IsTiled())
+    {
+        return canvas.Row(y).data();
+    }
+    canvas.ReadRow(0, y, canvas.Width(), scratch);
+    return scratch;
+}
+
+void GrayscalePlotter::StoreCanvasRow(const int y, const double* levels, char* scratch) const
+{
+    Canvas& canvas = RawCanvas();
+    if (!canvas.IsTiled())
+    {
+        QuantizeRow(levels, canvas.Row(y).data(), canvas.Width());
+        return;
+    }
+    QuantizeRow(levels, scratch, canvas.Width());
+    StoreCanvasChars(y, scratch);
+}
+
+void GrayscalePlotter::StoreCanvasChars(const int y, const char* row) const
+{
+    Canvas& canvas = RawCanvas();
+    if (!canvas.IsTiled())
+    {
+        canvas.WriteRow(0, y, canvas.Width(), row);
+        return;
+    }
+
+    // Неизменившийся кусок плитки не пишется: однородная плитка так и
+    // остается без пикселей
+    char current[Canvas::kTileSize];
+    for (int x = 0; x < canvas.Width(); x += Canvas::kTileSize)
+    {
+        const int count = std::min(Canvas::kTileSize, canvas.Width() - x);
+        canvas.ReadRow(x, y, count, current);
+        if (std::memcmp(current, row + x, count) != 0)
+        {
+            canvas.WriteRow(x, y, count, row + x);
+        }
+    }
+}
+
+void GrayscalePlotter::ForEachRowBand(const std::function<void(int, int)>& band) const
+{
+    // Потоки не делят плитки: запись в плитку может выделить ее пиксели
+    const int alignment = RawCanvas().IsTiled() ? Canvas::kTileSize : 1;
+    ThreadPool::ForEachBand(Pool(), RawCanvas().Height(), alignment, band);
+}
+
+void GrayscalePlotter::QuantizeRow(const double* src, char* dst, const size_t count) const
+{
+    SimdKernels::QuantizeLevels(src, lookup_.LevelToChar(), static_cast<int>(lookup_.Size()) - 1, dst, count);
+}
+
+void GrayscalePlotter::ForEachPixelBand(const std::function<void(size_t, size_t)>& band) const
+{
+    const size_t width = RawCanvas().Width();
+    ThreadPool::ForEachBand(Pool(), RawCanvas().Height(), 1,
+        [&](const int y_begin, const int y_end) { band(y_begin * width, y_end * width); });
+}
+
 void GrayscalePlotter::DrawLine(const int x1, const int y1, const int x2, const int y2, const double brightness)
 {
+    if (HasBrightnessBuffer())
+    {
+        Rasterizer::Line(x1, y1, x2, y2, CanvasClip(), BufferWriter(brightness));
+        return;
+    }
     Plotter::DrawLine(x1, y1, x2, y2, BrightnessToChar(brightness));
 }
 
 void GrayscalePlotter::DrawRectangle(const int x1, const int y1, const int x2, const int y2, const double brightness, const bool fill)
 {
+    if (HasBrightnessBuffer())
+    {
+        if (fill)
+        {
+            Rasterizer::FilledRectangle(x1, y1, x2, y2, CanvasClip(), BufferWriter(brightness));
+        }
+        else
+        {
+            DrawLine(x1, y1, x2, y1, brightness);
+            DrawLine(x2, y1, x2, y2, brightness);
+            DrawLine(x2, y2, x1, y2, brightness);
+            DrawLine(x1, y2, x1, y1, brightness);
+        }
+        return;
+    }
     Plotter::DrawRectangle(x1, y1, x2, y2, BrightnessToChar(brightness), fill);
 }
 
 void GrayscalePlotter::DrawTriangle(const int x1, const int y1, const int x2, const int y2, const int x3, const int y3,
     const double brightness, const bool fill)
 {
+    if (HasBrightnessBuffer())
+    {
+        if (fill)
+        {
+            Rasterizer::FilledTriangle(x1, y1, x2, y2, x3, y3, CanvasClip(), BufferWriter(brightness));
+        }
+        else
+        {
+            DrawLine(x1, y1, x2, y2, brightness);
+            DrawLine(x2, y2, x3, y3, brightness);
+            DrawLine(x3, y3, x1, y1, brightness);
+        }
+        return;
+    }
     Plotter::DrawTriangle(x1, y1, x2, y2, x3, y3, BrightnessToChar(brightness), fill);
 }
 
 void GrayscalePlotter::DrawCircle(const int center_x, const int center_y, const int radius,
     const double brightness, const bool fill)
 {
+    if (HasBrightnessBuffer())
+    {
+        if (fill)
+        {
+            Rasterizer::FilledCircle(center_x, center_y, radius, CanvasClip(), BufferWriter(brightness));
+        }
+        else
+        {
+            Rasterizer::CircleOutline(center_x, center_y, radius, CanvasClip(), BufferWriter(brightness));
+        }
+        return;
+    }
     Plotter::DrawCircle(center_x, center_y, radius, BrightnessToChar(brightness), fill);
 }
 
+void GrayscalePlotter::DrawEllipse(const int center_x, const int center_y, const int radius_x, const int radius_y,
+    const double brightness, const bool fill)
+{
+    if (HasBrightnessBuffer())
+    {
+        if (fill)
+        {
+            Rasterizer::FilledEllipse(center_x, center_y, radius_x, radius_y, CanvasClip(), BufferWriter(brightness));
+        }
+        else
+        {
+            Rasterizer::EllipseOutline(center_x, center_y, radius_x, radius_y, CanvasClip(), BufferWriter(brightness));
+        }
+        return;
+    }
+    Plotter::DrawEllipse(center_x, center_y, radius_x, radius_y, BrightnessToChar(brightness), fill);
+}
+
 void GrayscalePlotter::FloodFill(const int x, const int y, const double brightness)
 {
+    if (HasBrightnessBuffer())
+    {
+        FillBufferRegion(x, y, brightness);
+        return;
+    }
     Plotter::FloodFill(x, y, BrightnessToChar(brightness));
 }
 
 void GrayscalePlotter::ScanlineFill(const int x, const int y, const double brightness)
 {
+    if (HasBrightnessBuffer())
+    {
+        FillBufferRegion(x, y, brightness);
+        return;
+    }
     Plotter::ScanlineFill(x, y, BrightnessToChar(brightness));
 }
 
+void GrayscalePlotter::FillRegions(const std::span<const std::pair<int, int>> seeds, const double brightness)
+{
+    if (!HasBrightnessBuffer())
+    {
+        Plotter::FillRegions(seeds, BrightnessToChar(brightness));
+        return;
+    }
+    for (const auto& [x, y] : seeds)
+    {
+        FillBufferRegion(x, y, brightness);
+    }
+}
+
+void GrayscalePlotter::FillEnclosedRegions(const char target_brush, const double brightness)
+{
+    if (!HasBrightnessBuffer())
+    {
+        Plotter::FillEnclosedRegions(target_brush, BrightnessToChar(brightness));
+        return;
+    }
+
+    const RegionLabels& regions = Regions();
+    std::vector<char> selected(regions.RegionCount(), 0);
+    for (uint32_t label = 0; label < regions.RegionCount(); ++label)
+    {
+        selected[label] = regions.RegionChar(label) == target_brush && regions.IsEnclosed(label);
+    }
+    regions.ForEachSelectedRun(selected, Pool(), BufferWriter(brightness));
+}
+
+void GrayscalePlotter::Submit(const DrawCommandBuffer& commands)
+{
+    if (!HasBrightnessBuffer())
+    {
+        Plotter::Submit(commands.MapPaint([this](const double brightness)
+            { return static_cast<double>(BrightnessToChar(brightness)); }));
+        return;
+    }
+
+    ExecuteBatch<double>(*this, commands.Optimized(CanvasClip()));
+}
+
+void GrayscalePlotter::DrawBatchGradient(const DrawCommandBuffer::Command& command)
+{
+    const int* c = command.coords;
+    if (command.op == DrawCommandBuffer::Op::LinearGradient)
+    {
+        DrawLinearGradient(c[0], c[1], c[2], c[3], command.values[0], command.values[1]);
+    }
+    else
+    {
+        DrawRadialGradient(c[0], c[1], c[2], command.values[0], command.values[1]);
+    }
+}
+
 void GrayscalePlotter::DrawLinearGradient(const int x1, const int y1, const int x2, const int y2,
     const double start_brightness, const double end_brightness)
 {
@@ -63,7 +326,7 @@ void GrayscalePlotter::DrawLinearGradient(const int x1, const int y1, const int
     {
         for (int x = x1; x <= x2; ++x)
         {
-            if (!GetCanvas().InBounds(x, y))
+            if (!RawCanvas().InBounds(x, y))
                 continue;
 
             const double x_ratio = static_cast<double>(x - x1) / width;
@@ -71,7 +334,7 @@ void GrayscalePlotter::DrawLinearGradient(const int x1, const int y1, const int
             const double ratio = (x_ratio + y_ratio) / 2.0;
 
             const double brightness = start_brightness + ratio * (end_brightness - start_brightness);
-            GetCanvas().at(x, y) = BrightnessToChar(brightness);
+            SetPixelBrightness(x, y, brightness);
         }
     }
 }
@@ -83,7 +346,7 @@ void GrayscalePlotter::DrawRadialGradient(const int center_x, const int center_y
     {
         for (int x = center_x - radius; x <= center_x + radius; ++x)
         {
-            if (!GetCanvas().InBounds(x, y))
+            if (!RawCanvas().InBounds(x, y))
                 continue;
 
             const double distance = std::sqrt(std::pow(x - center_x, 2) + std::pow(y - center_y, 2));
@@ -92,28 +355,35 @@ void GrayscalePlotter::DrawRadialGradient(const int center_x, const int center_y
 
             const double ratio = distance / radius;
             const double brightness = center_brightness + ratio * (edge_brightness - center_brightness);
-            GetCanvas().at(x, y) = BrightnessToChar(brightness);
+            SetPixelBrightness(x, y, brightness);
         }
     }
 }
 
 double GrayscalePlotter::CalculateAverageBrightness()
 {
+    PullCanvasWrites();
+    if (HasBrightnessBuffer())
+    {
+        if (brightness_.empty())
+            return 0.0;
+        return std::accumulate(brightness_.begin(), brightness_.end(), 0.0) / brightness_.size();
+    }
+
     double total = 0.0;
     int count = 0;
 
-    std::map<char, double> char_to_brightness;
-    for (size_t i = 0; i < palette_.size(); ++i)
-    {
-        const double brightness = static_cast<double>(i) / (palette_.size() - 1);
-        char_to_brightness[palette_[i]] = brightness;
-    }
-    for (auto pixel : GetCanvas())
+    std::vector<char> scratch(RawCanvas().Width());
+    for (int y = 0; y < RawCanvas().Height(); ++y)
     {
-        if (const auto it = char_to_brightness.find(pixel); it != char_to_brightness.end())
+        const char* row = ReadCanvasRow(y, scratch.data());
+        for (int x = 0; x < RawCanvas().Width(); ++x)
         {
-            total += it->second;
-            count++;
+            if (lookup_.Contains(row[x]))
+            {
+                total += lookup_.Level(row[x]);
+                count++;
+            }
         }
     }
 
@@ -122,28 +392,33 @@ double GrayscalePlotter::CalculateAverageBrightness()
 
 std::pair<double, double> GrayscalePlotter::GetMinMaxBrightness()
 {
-    if (GetCanvas().Size() == 0)
+    if (RawCanvas().Size() == 0)
     {
         return { 0.0, 0.0 };
     }
 
-    std::map<char, double> char_to_brightness;
-    for (size_t i = 0; i < palette_.size(); ++i)
+    PullCanvasWrites();
+    if (HasBrightnessBuffer())
     {
-        const double brightness = static_cast<double>(i) / (palette_.size() - 1);
-        char_to_brightness[palette_[i]] = brightness;
+        const auto [min_it, max_it] = std::minmax_element(brightness_.begin(), brightness_.end());
+        return { *min_it, *max_it };
     }
 
     double min_brightness = 1.0;
     double max_brightness = 0.0;
 
-    for (const auto& pixel : GetCanvas())
+    std::vector<char> scratch(RawCanvas().Width());
+    for (int y = 0; y < RawCanvas().Height(); ++y)
     {
-        if (const auto it = char_to_brightness.find(pixel); it != char_to_brightness.end())
+        const char* row = ReadCanvasRow(y, scratch.data());
+        for (int x = 0; x < RawCanvas().Width(); ++x)
         {
-            double brightness = it->second;
-            min_brightness = std::min(min_brightness, brightness);
-            max_brightness = std::max(max_brightness, brightness);
+            if (lookup_.Contains(row[x]))
+            {
+                const double brightness = lookup_.Level(row[x]);
+                min_brightness = std::min(min_brightness, brightness);
+                max_brightness = std::max(max_brightness, brightness);
+            }
         }
     }
 
@@ -152,23 +427,22 @@ std::pair<double, double> GrayscalePlotter::GetMinMaxBrightness()
 
 std::vector<std::vector<double>> GrayscalePlotter::GetBrightnessMatrix() const
 {
-    std::vector<std::vector<double>> matrix(GetCanvas().Height(),
-        std::vector<double>(GetCanvas().Width()));
+    PullCanvasWrites();
+    std::vector<std::vector<double>> matrix(RawCanvas().Height(),
+        std::vector<double>(RawCanvas().Width()));
 
-    std::map<char, double> char_to_brightness;
-    for (size_t i = 0; i < palette_.size(); ++i)
+    std::vector<char> scratch(RawCanvas().Width());
+    for (int y = 0; y < RawCanvas().Height(); ++y)
     {
-        const double brightness = static_cast<double>(i) / (palette_.size() - 1);
-        char_to_brightness[palette_[i]] = brightness;
-    }
-
-    for (int y = 0; y < GetCanvas().Height(); ++y)
-    {
-        for (int x = 0; x < GetCanvas().Width(); ++x)
+        if (HasBrightnessBuffer())
         {
-            char pixel_char = GetCanvas().at(x, y);
-            auto it = char_to_brightness.find(pixel_char);
-            matrix[y][x] = it != char_to_brightness.end() ? it->second : 0.0;
+            const auto row = brightness_.begin() + BufferIndex(0, y);
+            std::copy(row, row + RawCanvas().Width(), matrix[y].begin());
+        }
+        else
+        {
+            SimdKernels::DecodeLevels(lookup_.LevelTable(), ReadCanvasRow(y, scratch.data()), matrix[y].data(),
+                scratch.size());
         }
     }
 
@@ -177,264 +451,435 @@ std::vector<std::vector<double>> GrayscalePlotter::GetBrightnessMatrix() const
 
 void GrayscalePlotter::AdjustBrightness(const double factor)
 {
-    std::map<char, double> char_to_brightness;
-    for (size_t i = 0; i < palette_.size(); ++i)
-    {
-        const double brightness = static_cast<double>(i) / (palette_.size() - 1);
-        char_to_brightness[palette_[i]] = brightness;
-    }
+    ApplyFilterChain(FilterChain().AdjustBrightness(factor));
+}
+
+void GrayscalePlotter::ApplyThreshold(const double threshold)
+{
+    ApplyFilterChain(FilterChain().Threshold(threshold));
+}
 
-    for (int y = 0; y < GetCanvas().Height(); ++y)
+void GrayscalePlotter::InvertBrightness()
+{
+    ApplyFilterChain(FilterChain().Invert());
+}
+
+void GrayscalePlotter::ApplyFilterChain(const FilterChain& chain)
+{
+    const auto& stages = chain.Stages();
+    for (size_t i = 0; i < stages.size();)
     {
-        for (int x = 0; x < GetCanvas().Width(); ++x)
+        // Размытия - барьеры конвейера; между ними точечные операции сливаются в один проход
+        if (!FilterChain::IsPointwise(stages[i]))
         {
-            char old_char = GetCanvas().at(x, y);
-            if (auto it = char_to_brightness.find(old_char); it != char_to_brightness.end())
-            {
-                const double new_brightness = std::clamp(it->second * factor, 0.0, 1.0);
-                GetCanvas().at(x, y) = BrightnessToChar(new_brightness);
-            }
+            if (stages[i].type == FilterChain::StageType::BoxBlur)
+                ApplyBoxBlur(stages[i].kernel_size);
+            else
+                ApplyGaussianBlur(stages[i].kernel_size);
+            ++i;
+            continue;
         }
+
+        size_t end = i;
+        while (end < stages.size() && FilterChain::IsPointwise(stages[end]))
+            ++end;
+
+        ApplyPointStages(stages.data() + i, stages.data() + end);
+        i = end;
     }
 }
 
-void GrayscalePlotter::ApplyThreshold(const double threshold)
+void GrayscalePlotter::ApplyPointStages(const FilterChain::Stage* begin, const FilterChain::Stage* end)
 {
-    std::map<char, double> char_to_brightness;
-    for (size_t i = 0; i < palette_.size(); ++i)
+    if (HasBrightnessBuffer())
     {
-        const double brightness = static_cast<double>(i) / (palette_.size() - 1);
-        char_to_brightness[palette_[i]] = brightness;
+        PullCanvasWrites();
+        // Все стадии применяются к блоку, пока он лежит в кэше
+        ForEachPixelBand([&](const size_t band_begin, const size_t band_end)
+        {
+            for (size_t chunk = band_begin; chunk < band_end; chunk += kPointChunkSize)
+            {
+                const size_t count = std::min(kPointChunkSize, band_end - chunk);
+                for (auto stage = begin; stage != end; ++stage)
+                {
+                    FilterChain::ApplyPoint(*stage, brightness_.data() + chunk, count);
+                }
+            }
+        });
+        MarkAllRowsDirty();
+        return;
     }
 
-    for (int y = 0; y < GetCanvas().Height(); ++y)
+    // Композиция таблиц char -> char дает тот же результат, что и поочередное применение
+    PaletteLookup::CharTable table{};
+    for (size_t c = 0; c < table.size(); ++c)
+    {
+        table[c] = static_cast<char>(c);
+    }
+    for (auto stage = begin; stage != end; ++stage)
     {
-        for (int x = 0; x < GetCanvas().Width(); ++x)
+        const auto step = lookup_.BuildRemap([stage](const double brightness)
+            { return FilterChain::ApplyPoint(*stage, brightness); });
+        for (char& c : table)
         {
-            char old_char = GetCanvas().at(x, y);
-            if (const auto it = char_to_brightness.find(old_char); it != char_to_brightness.end())
-            {
-                const double new_brightness = it->second >= threshold ? 1.0 : 0.0;
-                GetCanvas().at(x, y) = BrightnessToChar(new_brightness);
-            }
+            c = step[static_cast<unsigned char>(c)];
         }
     }
+    ApplyRemap(table);
 }
 
-void GrayscalePlotter::InvertBrightness()
+void GrayscalePlotter::ApplyRemap(const PaletteLookup::CharTable& table)
 {
-    std::map<char, double> char_to_brightness;
-    for (size_t i = 0; i < palette_.size(); ++i)
-    {
-        const double brightness = static_cast<double>(i) / (palette_.size() - 1);
-        char_to_brightness[palette_[i]] = brightness;
-    }
-
-    for (int y = 0; y < GetCanvas().Height(); ++y)
+    PullCanvasWrites();
+    Canvas& canvas = RawCanvas();
+    ForEachRowBand([&](const int y_begin, const int y_end)
     {
-        for (int x = 0; x < GetCanvas().Width(); ++x)
+        std::vector<char> scratch(canvas.IsTiled() ? canvas.Width() : 0);
+        for (int y = y_begin; y < y_end; ++y)
         {
-            char old_char = GetCanvas().at(x, y);
-            if (const auto it = char_to_brightness.find(old_char); it != char_to_brightness.end())
+            if (!canvas.IsTiled())
             {
-                const double new_brightness = 1.0 - it->second;
-                GetCanvas().at(x, y) = BrightnessToChar(new_brightness);
+                SimdKernels::RemapBytes(table.data(), canvas.Row(y).data(), canvas.Width());
+                continue;
             }
+            canvas.ReadRow(0, y, canvas.Width(), scratch.data());
+            SimdKernels::RemapBytes(table.data(), scratch.data(), scratch.size());
+            StoreCanvasChars(y, scratch.data());
         }
-    }
-}
-
-char GrayscalePlotter::BrightnessToChar(double brightness) const {
-    int idx = brightness * (palette_.size() - 1);
-    return palette_[idx];
+    });
 }
 
-double GrayscalePlotter::GetPixelBrightness(const int x, const int y) const
+char GrayscalePlotter::BrightnessToChar(const double brightness) const
 {
-    if (!GetCanvas().InBounds(x, y))
-        return 0.0;
-
-    std::map<char, double> char_to_brightness;
-    for (size_t i = 0; i < palette_.size(); ++i)
-    {
-        const double brightness = static_cast<double>(i) / (palette_.size() - 1);
-        char_to_brightness[palette_[i]] = brightness;
-    }
-
-    const char pixel_char = GetCanvas().at(x, y);
-    const auto it = char_to_brightness.find(pixel_char);
-    return it != char_to_brightness.end() ? it->second : 0.0;
+    return lookup_.Quantize(brightness);
 }
 
 void GrayscalePlotter::SetPixelBrightness(const int x, const int y, const double brightness)
 {
-    if (GetCanvas().InBounds(x, y))
+    if (!RawCanvas().InBounds(x, y))
+        return;
+
+    if (HasBrightnessBuffer())
     {
-        GetCanvas().at(x, y) = BrightnessToChar(brightness);
+        BufferWriter(brightness)(x, y);
+        return;
     }
+
+    GetCanvas().at(x, y) = BrightnessToChar(brightness);
 }
 
-std::vector<std::vector<double>> GrayscalePlotter::CreateGaussianKernel(const int size, const double sigma)
+Convolution::Kernel GrayscalePlotter::CreateGaussianKernel(const int size, const double sigma)
 {
     if (size % 2 == 0)
     {
         throw std::invalid_argument("Kernel size must be odd");
     }
 
-    std::vector<std::vector<double>> kernel(size, std::vector<double>(size));
+    // Двумерное ядро Гаусса раскладывается в произведение двух одномерных
+    Convolution::Kernel kernel(size);
     double sum = 0.0;
     const int center = size / 2;
 
     for (int i = 0; i < size; ++i)
     {
-        for (int j = 0; j < size; ++j)
-        {
-            const int x = i - center;
-            const int y = j - center;
-            kernel[i][j] = std::exp(-(x * x + y * y) / (2 * sigma * sigma));
-            sum += kernel[i][j];
-        }
+        const int x = i - center;
+        kernel[i] = std::exp(-(x * x) / (2 * sigma * sigma));
+        sum += kernel[i];
     }
 
-    for (int i = 0; i < size; ++i)
+    for (double& weight : kernel)
     {
-        for (int j = 0; j < size; ++j)
-        {
-            kernel[i][j] /= sum;
-        }
+        weight /= sum;
     }
 
     return kernel;
 }
 
-std::vector<std::vector<double>> GrayscalePlotter::CreateBoxKernel(const int size)
+Convolution::Kernel GrayscalePlotter::CreateBoxKernel(const int size)
 {
-    std::vector<std::vector<double>> kernel(size, std::vector<double>(size));
-    const double value = 1.0 / (size * size);
+    return Convolution::Kernel(size, 1.0 / size);
+}
 
-    for (int i = 0; i < size; ++i)
+std::vector<double> GrayscalePlotter::CopyBrightnessPlane()
+{
+    PullCanvasWrites();
+    if (HasBrightnessBuffer())
     {
-        for (int j = 0; j < size; ++j)
-        {
-            kernel[i][j] = value;
-        }
+        // Свертка пишет в копию: если она бросит, буфер яркости останется целым
+        return brightness_;
     }
 
-    return kernel;
+    std::vector<double> plane(static_cast<size_t>(RawCanvas().Size()));
+    DecodeCanvas(plane.data());
+    return plane;
 }
 
-std::vector<std::vector<double>> GrayscalePlotter::Convolve(const std::vector<std::vector<double>>& kernel) const
+void GrayscalePlotter::StoreBrightnessPlane(std::vector<double>&& plane)
+{
+    if (HasBrightnessBuffer())
+    {
+        brightness_ = std::move(plane);
+        MarkAllRowsDirty();
+        return;
+    }
+
+    QuantizeCanvas(plane.data());
+}
+
+void GrayscalePlotter::ApplyBoxBlur(int kernel_size)
 {
-    const int kernel_size = kernel.size();
     if (kernel_size % 2 == 0)
     {
-        throw std::invalid_argument("Kernel size must be odd");
+        kernel_size++; // Делаем нечетным
     }
 
-    const int offset = kernel_size / 2;
-    const int width = GetCanvas().Width();
-    const int height = GetCanvas().Height();
+    auto plane = CopyBrightnessPlane();
+    if (kernel_size <= kDirectBoxKernelSize)
+    {
+        Convolution::Direct(plane, RawCanvas().Width(), RawCanvas().Height(), CreateBoxKernel(kernel_size), Pool());
+    }
+    else
+    {
+        // Стоимость скользящей суммы не зависит от размера ядра
+        Convolution::Box(plane, RawCanvas().Width(), RawCanvas().Height(), kernel_size, Pool());
+    }
+    StoreBrightnessPlane(std::move(plane));
+}
 
-    std::vector<std::vector<double>> result(height, std::vector<double>(width, 0.0));
+void GrayscalePlotter::ApplyGaussianBlur(int kernel_size)
+{
+    if (kernel_size % 2 == 0)
+    {
+        kernel_size++; // Делаем нечетным
+    }
+
+    const double sigma = kernel_size / 3.0;
+    const auto kernel = CreateGaussianKernel(kernel_size, sigma);
+
+    auto plane = CopyBrightnessPlane();
+    Convolution::Separable(plane, RawCanvas().Width(), RawCanvas().Height(), kernel, Pool());
+    StoreBrightnessPlane(std::move(plane));
+}
 
-    for (int y = 0; y < height; ++y)
+void GrayscalePlotter::SetPalette(const std::vector<char>& new_palette)
+{
+    if (new_palette.empty())
+        return;
+
+    if (HasBrightnessBuffer())
     {
-        for (int x = 0; x < width; ++x)
-        {
-            double sum = 0.0;
+        // Строки холста декодируются еще по старой палитре
+        PullCanvasWrites();
+        palette_ = new_palette;
+        lookup_.Rebuild(palette_);
+        MarkAllRowsDirty();
+        return;
+    }
 
-            for (int ky = 0; ky < kernel_size; ++ky)
-            {
-                for (int kx = 0; kx < kernel_size; ++kx)
-                {
-                    int src_x = x + kx - offset;
-                    int src_y = y + ky - offset;
-
-                    // Обработка границ: отражаем
-                    if (src_x < 0)
-                    {
-                        src_x = -src_x;
-                    }
-                    if (src_x >= width)
-                    {
-                        src_x = 2 * width - src_x - 1;
-                    }
-                    if (src_y < 0)
-                    {
-                        src_y = -src_y;
-                    }
-                    if (src_y >= height)
-                    {
-                        src_y = 2 * height - src_y - 1;
-                    }
-
-                    if (GetCanvas().InBounds(src_x, src_y))
-                    {
-                        const double pixel_brightness = GetPixelBrightness(src_x, src_y);
-                        sum += pixel_brightness * kernel[ky][kx];
-                    }
-                }
-            }
+    {
+        const auto brightness_matrix = GetBrightnessMatrix();
 
-            result[y][x] = std::clamp(sum, 0.0, 1.0);
+        palette_ = new_palette;
+        lookup_.Rebuild(palette_);
+
+        std::vector<char> scratch(RawCanvas().Width());
+        for (int y = 0; y < RawCanvas().Height(); ++y)
+        {
+            StoreCanvasRow(y, brightness_matrix[y].data(), scratch.data());
         }
     }
+}
 
-    return result;
+void GrayscalePlotter::PasteRegion(const Canvas& region, const int x, const int y)
+{
+    if (!HasBrightnessBuffer())
+    {
+        Plotter::PasteRegion(region, x, y);
+        return;
+    }
+
+    if (!region.IsTiled())
+    {
+        PasteRegion(region.View(), x, y);
+        return;
+    }
+
+    std::vector<char> row(region.Width());
+    for (int ry = 0; ry < region.Height(); ++ry)
+    {
+        region.ReadRow(0, ry, region.Width(), row.data());
+        PasteRegion(ConstCanvasView(row.data(), region.Width(), 1, region.Width()), x, y + ry);
+    }
 }
 
-void GrayscalePlotter::ApplyBoxBlur(int kernel_size)
+void GrayscalePlotter::PasteRegion(const ConstCanvasView region, const int x, const int y)
 {
-    if (kernel_size % 2 == 0)
+    if (!HasBrightnessBuffer())
     {
-        kernel_size++; // Делаем нечетным
+        Plotter::PasteRegion(region, x, y);
+        return;
     }
 
-    const auto kernel = CreateBoxKernel(kernel_size);
-    const auto convolved = Convolve(kernel);
+    PullCanvasWrites();
+    const int left = std::max(x, 0);
+    const int right = std::min(x + region.Width(), RawCanvas().Width());
+    const int top = std::max(y, 0);
+    const int bottom = std::min(y + region.Height(), RawCanvas().Height());
 
-    for (int y = 0; y < GetCanvas().Height(); ++y)
+    for (int dest_y = top; dest_y < bottom; ++dest_y)
     {
-        for (int x = 0; x < GetCanvas().Width(); ++x)
-        {
-            SetPixelBrightness(x, y, convolved[y][x]);
-        }
+        SimdKernels::DecodeLevels(lookup_.LevelTable(), region.Row(dest_y - y) + (left - x),
+            brightness_.data() + BufferIndex(left, dest_y), std::max(right - left, 0));
+        dirty_rows_[dest_y] = true;
     }
 }
 
-void GrayscalePlotter::ApplyGaussianBlur(int kernel_size)
+void GrayscalePlotter::EnableBrightnessBuffer(const bool enable)
 {
-    if (kernel_size % 2 == 0)
+    if (enable == HasBrightnessBuffer())
+        return;
+
+    if (enable)
     {
-        kernel_size++; // Делаем нечетным
+        const Canvas& canvas = GetCanvas();
+        brightness_.resize(static_cast<size_t>(canvas.Size()));
+        DecodeCanvas(brightness_.data());
+        dirty_rows_.assign(canvas.Height(), false);
+        synced_revisions_.resize(canvas.Height());
+        for (int y = 0; y < canvas.Height(); ++y)
+        {
+            synced_revisions_[y] = canvas.RowRevision(y);
+        }
+        synced_revision_ = canvas.Revision();
+        brightness_mode_ = true;
     }
+    else
+    {
+        QuantizeBrightnessBuffer();
+        brightness_mode_ = false;
+        brightness_ = {};
+        dirty_rows_ = {};
+        synced_revisions_ = {};
+    }
+}
 
-    const double sigma = kernel_size / 3.0;
-    const auto kernel = CreateGaussianKernel(kernel_size, sigma);
-    const auto convolved = Convolve(kernel);
+void GrayscalePlotter::QuantizeBrightnessBuffer() const
+{
+    if (!HasBrightnessBuffer())
+        return;
 
-    // Применяем результат к canvas
-    for (int y = 0; y < GetCanvas().Height(); ++y)
+    PullCanvasWrites();
+    Canvas& canvas = RawCanvas();
+    ForEachRowBand([&](const int y_begin, const int y_end)
     {
-        for (int x = 0; x < GetCanvas().Width(); ++x)
+        std::vector<char> scratch(canvas.IsTiled() ? canvas.Width() : 0);
+        for (int y = y_begin; y < y_end; ++y)
         {
-            SetPixelBrightness(x, y, convolved[y][x]);
+            if (!dirty_rows_[y])
+                continue;
+
+            StoreCanvasRow(y, brightness_.data() + BufferIndex(0, y), scratch.data());
+            dirty_rows_[y] = false;
+            synced_revisions_[y] = canvas.RowRevision(y);
         }
+    });
+    // Холст опередил буфер только в строках, которые PullCanvasWrites уже забрал
+    synced_revision_ = canvas.Revision();
+}
+
+void GrayscalePlotter::PullCanvasWrites() const
+{
+    // Отложенные команды записаны после того, как буфер ушел в холст
+    Plotter::SyncCanvas();
+    if (!HasBrightnessBuffer())
+        return;
+
+    const Canvas& canvas = RawCanvas();
+    if (canvas.Revision() == synced_revision_)
+        return;
+
+    // Холст могли заменить целиком, в том числе холстом другого размера
+    if (brightness_.size() != static_cast<size_t>(canvas.Size()) ||
+        synced_revisions_.size() != static_cast<size_t>(canvas.Height()))
+    {
+        brightness_.assign(static_cast<size_t>(canvas.Size()), 0.0);
+        dirty_rows_.assign(canvas.Height(), false);
+        synced_revisions_.assign(canvas.Height(), ~uint64_t{0});
     }
+
+    ForEachRowBand([&](const int y_begin, const int y_end)
+    {
+        std::vector<char> row(canvas.Width());
+        for (int y = y_begin; y < y_end; ++y)
+        {
+            if (canvas.RowRevision(y) == synced_revisions_[y])
+                continue;
+
+            canvas.ReadRow(0, y, canvas.Width(), row.data());
+            SimdKernels::DecodeLevels(lookup_.LevelTable(), row.data(), brightness_.data() + BufferIndex(0, y),
+                row.size());
+            dirty_rows_[y] = false;
+            synced_revisions_[y] = canvas.RowRevision(y);
+        }
+    });
+    synced_revision_ = canvas.Revision();
 }
 
-void GrayscalePlotter::SetPalette(const std::vector<char>& new_palette)
+void GrayscalePlotter::SyncCanvas() const
+{
+    Plotter::SyncCanvas();
+    QuantizeBrightnessBuffer();
+}
+
+void GrayscalePlotter::BeforeCanvasWrite()
 {
-    if (!new_palette.empty())
+    // Без измененных строк буфера переносить нечего, и отложенные команды остаются в списке
+    if (std::find(dirty_rows_.begin(), dirty_rows_.end(), true) != dirty_rows_.end())
+        QuantizeBrightnessBuffer();
+}
+
+void GrayscalePlotter::FillBufferRegion(const int x, const int y, const double brightness)
+{
+    if (!RawCanvas().InBounds(x, y))
+        return;
+
+    PullCanvasWrites();
+    const double target = brightness_[BufferIndex(x, y)];
+    const double fill = std::clamp(brightness, 0.0, 1.0);
+    if (target == fill)
+        return;
+
+    const int width = RawCanvas().Width();
+    const int height = RawCanvas().Height();
+    auto matches = [&](const int px, const int py) { return brightness_[BufferIndex(px, py)] == target; };
+
+    std::vector<std::pair<int, int>> seeds = { { x, y } };
+    while (!seeds.empty())
     {
-        palette_ = new_palette;
+        const auto [sx, sy] = seeds.back();
+        seeds.pop_back();
+        if (!matches(sx, sy))
+            continue;
 
-        const auto brightness_matrix = GetBrightnessMatrix();
-        for (int y = 0; y < GetCanvas().Height(); ++y)
+        int left = sx;
+        int right = sx;
+        while (left > 0 && matches(left - 1, sy))
+            --left;
+        while (right < width - 1 && matches(right + 1, sy))
+            ++right;
+
+        BufferWriter(fill)(sy, left, right);
+
+        for (const int ny : { sy - 1, sy + 1 })
         {
-            for (int x = 0; x < GetCanvas().Width(); ++x)
+            if (ny < 0 || ny >= height)
+                continue;
+
+            // Одно зерно на каждый непрерывный отрезок соседней строки
+            for (int nx = left; nx <= right; ++nx)
             {
-                GetCanvas().at(x, y) = BrightnessToChar(brightness_matrix[y][x]);
+                if (matches(nx, ny) && (nx == left || !matches(nx - 1, ny)))
+                    seeds.emplace_back(nx, ny);
             }
         }
     }
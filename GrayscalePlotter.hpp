@@ -1,7 +1,12 @@
 #pragma once
+#include "Convolution.hpp"
+#include "FilterChain.hpp"
+#include "PaletteLookup.hpp"
 #include "Plotter.hpp"
 #include <algorithm>
+#include <functional>
 #include <memory>
+#include <span>
 #include <vector>
 
 namespace plotter
@@ -16,15 +21,28 @@ public:
     GrayscalePlotter(int width, int height, char background_char = ' ',
         const std::vector<char>& palette = DefaultPalette());
 
+    ~GrayscalePlotter() override;
+
     static std::vector<char> DefaultPalette();
 
     void DrawLine(int x1, int y1, int x2, int y2, double brightness);
     void DrawRectangle(int x1, int y1, int x2, int y2, double brightness, bool fill = false);
     void DrawTriangle(int x1, int y1, int x2, int y2, int x3, int y3, double brightness, bool fill = false);
     void DrawCircle(int center_x, int center_y, int radius, double brightness, bool fill = false);
+    void DrawEllipse(int center_x, int center_y, int radius_x, int radius_y, double brightness, bool fill = false);
 
     void FloodFill(int x, int y, double brightness);
     void ScanlineFill(int x, int y, double brightness);
+    // В режиме буфера яркости FillRegions заливает область каждой точки
+    // по равенству яркостей, как ScanlineFill, а FillEnclosedRegions ищет
+    // области по символам синхронизированного холста
+    void FillRegions(std::span<const std::pair<int, int>> seeds, double brightness);
+    void FillEnclosedRegions(char target_brush, double brightness);
+
+    // Пакет с яркостями вместо символов. Без буфера яркости каждая яркость
+    // переводится в символ один раз до оптимизации, так что команды разной
+    // яркости с одним символом сливаются
+    void Submit(const DrawCommandBuffer& commands);
 
     void DrawLinearGradient(int x1, int y1, int x2, int y2,
         double start_brightness, double end_brightness);
@@ -38,24 +56,87 @@ public:
     void AdjustBrightness(double factor);
     void ApplyThreshold(double threshold);
     void InvertBrightness();
+    void ApplyFilterChain(const FilterChain& chain);
 
     void ApplyBoxBlur(int kernel_size = 3);
     void ApplyGaussianBlur(int kernel_size = 3);
 
+    void PasteRegion(const Canvas& region, int x, int y);
+    void PasteRegion(ConstCanvasView region, int x, int y);
+
+    // Буфер яркости: рисование яркостью, фильтры и запросы яркости работают
+    // с double на пиксель, а холст получает символы лениво, по измененным
+    // строкам. Источник истины для строки - та сторона, что менялась позже:
+    // - GetCanvas, Render, сохранение и чтения Plotter сначала переводят
+    //   измененные строки буфера в символы;
+    // - запись символами через методы Plotter (в том числе через Plotter&)
+    //   сначала переносит в холст строки буфера, а операция с буфером
+    //   перед началом забирает в буфер строки холста, у которых сменился
+    //   RowRevision. Такая строка декодируется из символов целиком и теряет
+    //   промежуточные яркости;
+    // - ссылка из GetCanvas годится для записи до следующей операции с
+    //   буфером. Если строку после этого изменили и в буфере, и через
+    //   старую ссылку, в строке остается запись через ссылку
+    void EnableBrightnessBuffer(bool enable = true);
+    [[nodiscard]] bool HasBrightnessBuffer() const noexcept { return brightness_mode_; }
+    void QuantizeBrightnessBuffer() const;
+
     void SetPalette(const std::vector<char>& new_palette);
     [[nodiscard]] const std::vector<char>& GetPalette() const noexcept { return palette_; }
     [[nodiscard]] size_t GetPaletteSize() const noexcept { return palette_.size(); }
 
+protected:
+    void SyncCanvas() const override;
+    void BeforeCanvasWrite() override;
+    void DrawBatchGradient(const DrawCommandBuffer::Command& command) override;
+
 private:
+    static constexpr int kDirectBoxKernelSize = 3;
+    static constexpr size_t kPointChunkSize = 4096;
+
+    struct BrightnessWriter;
+
     std::vector<char> palette_;
+    PaletteLookup lookup_;
+
+    bool brightness_mode_ = false;
+    mutable std::vector<double> brightness_;
+    // Строки буфера, еще не переведенные в символы
+    mutable std::vector<char> dirty_rows_;
+    // RowRevision строк и Revision холста, когда холст и буфер последний раз совпадали
+    mutable std::vector<uint64_t> synced_revisions_;
+    mutable uint64_t synced_revision_ = 0;
 
     char BrightnessToChar(double brightness) const;
+    void ApplyRemap(const PaletteLookup::CharTable& table);
+    void ApplyPointStages(const FilterChain::Stage* begin, const FilterChain::Stage* end);
+
+    size_t BufferIndex(int x, int y) const noexcept { return static_cast<size_t>(y) * RawCanvas().Width() + x; }
+    BrightnessWriter BufferWriter(double brightness);
+    void MarkAllRowsDirty();
+    // Отложенные команды рисуются, а в режиме буфера строки холста,
+    // измененные символами, декодируются в буфер
+    void PullCanvasWrites() const;
+    // Яркостные проходы идут по строкам: плотный холст отдает строку на
+    // месте, плиточный - копией, и в него пишутся только изменившиеся куски
+    // плиток, так что однородные плитки остаются без пикселей
+    void DecodeCanvas(double* dst) const;
+    void QuantizeCanvas(const double* src) const;
+    const char* ReadCanvasRow(int y, char* scratch) const;
+    void StoreCanvasRow(int y, const double* levels, char* scratch) const;
+    void StoreCanvasChars(int y, const char* row) const;
+    void QuantizeRow(const double* src, char* dst, size_t count) const;
+    void ForEachRowBand(const std::function<void(int, int)>& band) const;
+    void ForEachPixelBand(const std::function<void(size_t, size_t)>& band) const;
+    void FillBufferRegion(int x, int y, double brightness);
 
-    double GetPixelBrightness(int x, int y) const;
     void SetPixelBrightness(int x, int y, double brightness);
-    std::vector<std::vector<double>> Convolve(const std::vector<std::vector<double>>& kernel) const;
-    static std::vector<std::vector<double>> CreateGaussianKernel(int size, double sigma = 1.0);
-    static std::vector<std::vector<double>> CreateBoxKernel(int size);
+    // Копия плоскости яркости для свертки; StoreBrightnessPlane ставит ее на
+    // место буфера только после успешной свертки
+    std::vector<double> CopyBrightnessPlane();
+    void StoreBrightnessPlane(std::vector<double>&& plane);
+    static Convolution::Kernel CreateGaussianKernel(int size, double sigma = 1.0);
+    static Convolution::Kernel CreateBoxKernel(int size);
 };
 
 } // namespace plotter
\ No newline at end of file
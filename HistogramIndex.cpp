@@ -0,0 +1,317 @@
+#include "HistogramIndex.hpp"
+#include <algorithm>
+
+namespace plotter
+{
+
+HistogramIndex::HistogramIndex(const Canvas& canvas)
+{
+    Refresh(canvas);
+}
+
+void HistogramIndex::Refresh(const Canvas& canvas)
+{
+    if (IsCurrent(canvas))
+    {
+        return;
+    }
+
+    std::vector<bool> changed(static_cast<size_t>(canvas.Height()), true);
+    bool fresh = true;
+    if (&canvas == canvas_ && canvas.Width() == width_ && canvas.Height() == height_)
+    {
+        for (int y = 0; y < height_; ++y)
+        {
+            changed[y] = canvas.RowRevision(y) != row_revisions_[y];
+            fresh = fresh && !changed[y];
+        }
+        // Новый номер правки без измененных строк - холст присвоили целиком
+    }
+
+    if (fresh)
+    {
+        width_ = canvas.Width();
+        height_ = canvas.Height();
+        blocks_x_ = width_ >> kBlockShift;
+        blocks_y_ = height_ >> kBlockShift;
+        slots_.fill(kNoSlot);
+        chars_.clear();
+        totals_.clear();
+        planes_.clear();
+        blocks_.clear();
+        std::fill(changed.begin(), changed.end(), true);
+    }
+    Update(canvas, changed, fresh);
+    DropEmptySlots();
+
+    canvas_ = &canvas;
+    revision_ = canvas.Revision();
+    row_revisions_.resize(height_);
+    for (int y = 0; y < height_; ++y)
+    {
+        row_revisions_[y] = canvas.RowRevision(y);
+    }
+}
+
+HistogramIndex::Counts HistogramIndex::Histogram(const int x1, const int y1, const int x2, const int y2) const
+{
+    const int left = std::max(x1, 0);
+    const int right = std::min(x2, width_ - 1) + 1;
+    const int top = std::max(y1, 0);
+    const int bottom = std::min(y2, height_ - 1) + 1;
+
+    Counts counts{};
+    if (left >= right || top >= bottom)
+    {
+        return counts;
+    }
+    if (static_cast<long long>(right - left) * (bottom - top) < kExactArea)
+    {
+        CountExact(left, top, right, bottom, counts);
+        return counts;
+    }
+
+    // Целые блоки внутри прямоугольника
+    const int block_left = (left + kBlockSize - 1) >> kBlockShift;
+    const int block_right = right >> kBlockShift;
+    const int block_top = (top + kBlockSize - 1) >> kBlockShift;
+    const int block_bottom = bottom >> kBlockShift;
+    if (block_left >= block_right || block_top >= block_bottom)
+    {
+        CountExact(left, top, right, bottom, counts);
+        return counts;
+    }
+
+    const size_t row = blocks_x_ + 1;
+    for (size_t slot = 0; slot < chars_.size(); ++slot)
+    {
+        const uint32_t* plane = BlockPlane(slot);
+        counts[static_cast<unsigned char>(chars_[slot])] =
+            plane[block_bottom * row + block_right] - plane[block_top * row + block_right] -
+            plane[block_bottom * row + block_left] + plane[block_top * row + block_left];
+    }
+
+    const int inner_left = block_left << kBlockShift;
+    const int inner_right = block_right << kBlockShift;
+    const int inner_top = block_top << kBlockShift;
+    const int inner_bottom = block_bottom << kBlockShift;
+    CountExact(left, top, right, inner_top, counts);
+    CountExact(left, inner_bottom, right, bottom, counts);
+    CountExact(left, inner_top, inner_left, inner_bottom, counts);
+    CountExact(inner_right, inner_top, right, inner_bottom, counts);
+    return counts;
+}
+
+void HistogramIndex::CountExact(const int x1, const int y1, const int x2, const int y2, Counts& counts) const
+{
+    if (x1 >= x2 || y1 >= y2)
+    {
+        return;
+    }
+
+    // Куски площадью меньше kExactArea: сумма по модулю 2^16 у них точная
+    const int chunk_height = std::min(y2 - y1, 255);
+    const int chunk_width = static_cast<int>((kExactArea - 1) / chunk_height);
+    const size_t row = width_ + 1;
+    for (int top = y1; top < y2; top += chunk_height)
+    {
+        const size_t bottom = std::min(top + chunk_height, y2);
+        for (int left = x1; left < x2; left += chunk_width)
+        {
+            const size_t right = std::min(left + chunk_width, x2);
+            for (size_t slot = 0; slot < chars_.size(); ++slot)
+            {
+                const uint16_t* plane = Plane(slot);
+                counts[static_cast<unsigned char>(chars_[slot])] += static_cast<uint16_t>(
+                    plane[bottom * row + right] - plane[top * row + right] - plane[bottom * row + left] +
+                    plane[top * row + left]);
+            }
+        }
+    }
+}
+
+void HistogramIndex::Update(const Canvas& canvas, const std::vector<bool>& changed, const bool fresh)
+{
+    std::vector<char> scratch(canvas.IsTiled() ? width_ : 0);
+    const auto read_row = [&](const int y)
+    {
+        if (!canvas.IsTiled())
+        {
+            return canvas.Row(y).data();
+        }
+        canvas.ReadRow(0, y, width_, scratch.data());
+        return static_cast<const char*>(scratch.data());
+    };
+
+    // Новые символы получают пустые таблицы до пересчета, память под них
+    // выделяется один раз
+    int first_row = height_;
+    std::array<bool, 256> added{};
+    size_t added_count = 0;
+    for (int y = 0; y < height_; ++y)
+    {
+        if (!changed[y])
+        {
+            continue;
+        }
+        first_row = std::min(first_row, y);
+        const char* row = read_row(y);
+        for (int x = 0; x < width_; ++x)
+        {
+            const auto c = static_cast<unsigned char>(row[x]);
+            if (slots_[c] == kNoSlot && !added[c])
+            {
+                added[c] = true;
+                ++added_count;
+            }
+        }
+    }
+    planes_.reserve(planes_.size() + added_count * PlaneSize());
+    blocks_.reserve(blocks_.size() + added_count * BlockPlaneSize());
+    for (int c = 0; c < 256; ++c)
+    {
+        if (added[c])
+        {
+            AddSlot(static_cast<char>(c));
+        }
+    }
+
+    // acc - сумма разностей измененных строк выше текущей для каждого x:
+    // на нее сдвигается строка таблицы. Строки таблиц символов, которые
+    // пока не менялись, не трогаются
+    const size_t slots = chars_.size();
+    const size_t row_size = width_ + 1;
+    const size_t block_row_size = blocks_x_ + 1;
+    std::vector<int32_t> acc(slots * row_size, 0);
+    std::vector<bool> active(slots, false);
+    std::vector<size_t> active_slots;
+    std::vector<bool> touched(slots);
+    std::vector<uint16_t> old_slots(width_);
+    std::vector<uint16_t> new_slots(width_);
+    for (int y = first_row; y < height_; ++y)
+    {
+        const size_t next = y + 1;
+        if (changed[y])
+        {
+            const char* row = read_row(y);
+            for (int x = 0; x < width_; ++x)
+            {
+                new_slots[x] = slots_[static_cast<unsigned char>(row[x])];
+            }
+
+            // Старая строка восстанавливается по таблицам: строка y уже
+            // сдвинута на acc, строка y + 1 еще прежняя
+            std::fill(old_slots.begin(), old_slots.end(), kNoSlot);
+            for (size_t slot = 0; slot < slots && !fresh; ++slot)
+            {
+                const uint16_t* above = Plane(slot) + y * row_size;
+                const uint16_t* below = above + row_size;
+                const int32_t* shift = acc.data() + slot * row_size;
+                uint16_t before = 0;
+                for (int x = 0; x < width_; ++x)
+                {
+                    const auto count = static_cast<uint16_t>(below[x + 1] - above[x + 1] + shift[x + 1]);
+                    if (static_cast<uint16_t>(count - before) == 1)
+                    {
+                        old_slots[x] = static_cast<uint16_t>(slot);
+                    }
+                    before = count;
+                }
+            }
+
+            std::fill(touched.begin(), touched.end(), false);
+            for (int x = 0; x < width_; ++x)
+            {
+                if (old_slots[x] != new_slots[x])
+                {
+                    touched[new_slots[x]] = true;
+                    if (old_slots[x] != kNoSlot)
+                    {
+                        touched[old_slots[x]] = true;
+                    }
+                }
+            }
+            for (size_t slot = 0; slot < slots; ++slot)
+            {
+                if (touched[slot] && !active[slot])
+                {
+                    active[slot] = true;
+                    active_slots.push_back(slot);
+                }
+            }
+        }
+
+        for (const size_t slot : active_slots)
+        {
+            uint16_t* plane = planes_.data() + slot * PlaneSize() + next * row_size;
+            int32_t* shift = acc.data() + slot * row_size;
+            if (changed[y] && touched[slot])
+            {
+                // Разность строки копится в acc и сразу переносится в таблицу
+                int32_t run = 0;
+                for (int x = 0; x < width_; ++x)
+                {
+                    shift[x] += run;
+                    plane[x] = static_cast<uint16_t>(plane[x] + shift[x]);
+                    run += (new_slots[x] == slot) - (old_slots[x] == slot);
+                }
+                shift[width_] += run;
+                plane[width_] = static_cast<uint16_t>(plane[width_] + shift[width_]);
+                totals_[slot] += run;
+            }
+            else
+            {
+                for (size_t x = 0; x < row_size; ++x)
+                {
+                    plane[x] = static_cast<uint16_t>(plane[x] + shift[x]);
+                }
+            }
+            if (next % kBlockSize == 0)
+            {
+                uint32_t* blocks = blocks_.data() + slot * BlockPlaneSize() + (next >> kBlockShift) * block_row_size;
+                for (size_t bx = 0; bx < block_row_size; ++bx)
+                {
+                    blocks[bx] = static_cast<uint32_t>(blocks[bx] + shift[bx << kBlockShift]);
+                }
+            }
+        }
+    }
+}
+
+void HistogramIndex::AddSlot(const char c)
+{
+    slots_[static_cast<unsigned char>(c)] = static_cast<uint16_t>(chars_.size());
+    chars_.push_back(c);
+    totals_.push_back(0);
+    planes_.resize(planes_.size() + PlaneSize(), 0);
+    blocks_.resize(blocks_.size() + BlockPlaneSize(), 0);
+}
+
+void HistogramIndex::DropEmptySlots()
+{
+    size_t kept = 0;
+    for (size_t slot = 0; slot < chars_.size(); ++slot)
+    {
+        const unsigned char c = static_cast<unsigned char>(chars_[slot]);
+        if (totals_[slot] == 0)
+        {
+            slots_[c] = kNoSlot;
+            continue;
+        }
+        if (kept != slot)
+        {
+            std::copy_n(planes_.begin() + slot * PlaneSize(), PlaneSize(), planes_.begin() + kept * PlaneSize());
+            std::copy_n(blocks_.begin() + slot * BlockPlaneSize(), BlockPlaneSize(),
+                        blocks_.begin() + kept * BlockPlaneSize());
+            chars_[kept] = chars_[slot];
+            totals_[kept] = totals_[slot];
+        }
+        slots_[c] = static_cast<uint16_t>(kept++);
+    }
+    chars_.resize(kept);
+    totals_.resize(kept);
+    planes_.resize(kept * PlaneSize());
+    blocks_.resize(kept * BlockPlaneSize());
+}
+
+} // namespace plotter
@@ -0,0 +1,95 @@
+#pragma once
+#include "Canvas.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace plotter
+{
+
+// Индекс гистограмм прямоугольников: для каждого символа, который есть на
+// холсте, своя таблица сумм по площади в полном разрешении. Счетчики
+// таблицы 16-битные и считаются по модулю 2^16, поэтому прямоугольник
+// площадью меньше kExactArea считается точно за O(числа символов) при любом
+// выравнивании. Большой прямоугольник берет середину из точной 32-битной
+// таблицы по углам блоков kBlockSize x kBlockSize, а края - кусками
+// меньше kExactArea из 16-битной. Память - 2 байта на символ на пиксель
+class HistogramIndex
+{
+public:
+    using Counts = std::array<uint32_t, 256>;
+
+    explicit HistogramIndex(const Canvas& canvas);
+
+    // Приводит индекс к холсту: по измененным строкам находятся символы,
+    // число которых в строке поменялось, и только их таблицы пересчитываются
+    // ниже первой такой строки. Новый символ получает свою таблицу, таблица
+    // исчезнувшего символа освобождается. Другой холст или размер
+    // перестраивают индекс целиком
+    void Refresh(const Canvas& canvas);
+
+    [[nodiscard]] bool IsCurrent(const Canvas& canvas) const noexcept
+    {
+        return &canvas == canvas_ && canvas.Revision() == revision_;
+    }
+
+    // Гистограмма прямоугольника [x1, x2] x [y1, y2], обрезанного по холсту
+    [[nodiscard]] Counts Histogram(int x1, int y1, int x2, int y2) const;
+    [[nodiscard]] const std::vector<char>& Chars() const noexcept { return chars_; }
+    [[nodiscard]] size_t MemoryUsage() const noexcept
+    {
+        return planes_.size() * sizeof(uint16_t) + blocks_.size() * sizeof(uint32_t);
+    }
+
+    static constexpr int kBlockShift = 7;
+    static constexpr int kBlockSize = 1 << kBlockShift;
+    static constexpr long long kExactArea = 1 << 16;
+
+private:
+    static constexpr uint16_t kNoSlot = 0xFFFF;
+
+    const Canvas* canvas_ = nullptr;
+    uint64_t revision_ = 0;
+    std::vector<uint64_t> row_revisions_;
+    int width_ = 0;
+    int height_ = 0;
+    // Число целых блоков по ширине и высоте
+    int blocks_x_ = 0;
+    int blocks_y_ = 0;
+    // Номер таблицы символа
+    std::array<uint16_t, 256> slots_;
+    std::vector<char> chars_;
+    // Число символа на всем холсте: таблица с нулем освобождается
+    std::vector<int64_t> totals_;
+    // Таблица символа slot: точка (x, y) - число символа в [0, x) x [0, y)
+    // по модулю 2^16, (width_ + 1) x (height_ + 1) точек подряд
+    std::vector<uint16_t> planes_;
+    // Те же суммы без потери разрядов, только в углах блоков
+    std::vector<uint32_t> blocks_;
+
+    // Переносит в таблицы изменения строк, отмеченных в changed. fresh -
+    // таблицы пусты, и старое содержимое строк разбирать не нужно
+    void Update(const Canvas& canvas, const std::vector<bool>& changed, bool fresh);
+    void AddSlot(char c);
+    void DropEmptySlots();
+    void CountExact(int x1, int y1, int x2, int y2, Counts& counts) const;
+    [[nodiscard]] size_t PlaneSize() const noexcept
+    {
+        return static_cast<size_t>(width_ + 1) * (height_ + 1);
+    }
+    [[nodiscard]] size_t BlockPlaneSize() const noexcept
+    {
+        return static_cast<size_t>(blocks_x_ + 1) * (blocks_y_ + 1);
+    }
+    [[nodiscard]] const uint16_t* Plane(size_t slot) const noexcept
+    {
+        return planes_.data() + slot * PlaneSize();
+    }
+    [[nodiscard]] const uint32_t* BlockPlane(size_t slot) const noexcept
+    {
+        return blocks_.data() + slot * BlockPlaneSize();
+    }
+};
+
+} // namespace plotter
@@ -0,0 +1,50 @@
+#include "PaletteLookup.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+namespace plotter
+{
+
+PaletteLookup::PaletteLookup(const std::vector<char>& palette)
+{
+    Rebuild(palette);
+}
+
+void PaletteLookup::Rebuild(const std::vector<char>& palette)
+{
+    if (palette.empty())
+    {
+        throw std::invalid_argument("Palette cannot be empty");
+    }
+
+    levels_.fill(0.0);
+    mapped_.fill(false);
+    level_to_char_ = palette;
+
+    // При повторах символа в палитре побеждает последнее вхождение
+    const size_t max_level = palette.size() > 1 ? palette.size() - 1 : 1;
+    for (size_t i = 0; i < palette.size(); ++i)
+    {
+        const size_t idx = Index(palette[i]);
+        levels_[idx] = static_cast<double>(i) / max_level;
+        mapped_[idx] = true;
+    }
+}
+
+char PaletteLookup::Quantize(const double brightness) const noexcept
+{
+    const int max_level = static_cast<int>(level_to_char_.size()) - 1;
+    if (!(brightness > 0.0))
+    {
+        return level_to_char_.front();
+    }
+    if (brightness >= 1.0)
+    {
+        return level_to_char_.back();
+    }
+
+    const int idx = static_cast<int>(brightness * max_level);
+    return level_to_char_[std::min(idx, max_level)];
+}
+
+} // namespace plotter
\ No newline at end of file
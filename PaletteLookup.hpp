@@ -0,0 +1,45 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <vector>
+
+namespace plotter
+{
+
+class PaletteLookup
+{
+public:
+    using CharTable = std::array<char, 256>;
+
+    explicit PaletteLookup(const std::vector<char>& palette);
+
+    void Rebuild(const std::vector<char>& palette);
+
+    [[nodiscard]] bool Contains(char c) const noexcept { return mapped_[Index(c)]; }
+    [[nodiscard]] double Level(char c) const noexcept { return levels_[Index(c)]; }
+    [[nodiscard]] char Quantize(double brightness) const noexcept;
+    [[nodiscard]] size_t Size() const noexcept { return level_to_char_.size(); }
+    [[nodiscard]] const double* LevelTable() const noexcept { return levels_.data(); }
+    [[nodiscard]] const char* LevelToChar() const noexcept { return level_to_char_.data(); }
+
+    template <typename Op>
+    [[nodiscard]] CharTable BuildRemap(Op op) const
+    {
+        CharTable table{};
+        for (size_t i = 0; i < table.size(); ++i)
+        {
+            const char c = static_cast<char>(i);
+            table[i] = mapped_[i] ? Quantize(op(levels_[i])) : c;
+        }
+        return table;
+    }
+
+private:
+    std::array<double, 256> levels_{};
+    std::array<bool, 256> mapped_{};
+    std::vector<char> level_to_char_;
+
+    static size_t Index(char c) noexcept { return static_cast<unsigned char>(c); }
+};
+
+} // namespace plotter
\ No newline at end of file
@@ -1,13 +1,40 @@
 #include "Plotter.hpp"
 #include "CanvasIterators.hpp"
+#include "Rasterizer.hpp"
+#include "TerminalRenderer.hpp"
+#include "ThreadPool.hpp"
 #include <algorithm>
+#include <array>
 #include <cmath>
-#include <queue>
-#include <stack>
+#include <functional>
+#include <utility>
+#include <stdexcept>
+#include <thread>
 
 namespace plotter
 {
 
+namespace
+{
+
+struct CanvasWriter
+{
+    Canvas& canvas;
+    char brush;
+
+    void operator()(const int x, const int y) const
+    {
+        canvas(x, y) = brush;
+    }
+
+    void operator()(const int y, const int x_begin, const int x_end) const
+    {
+        canvas.FillRegion(x_begin, y, x_end, y, brush);
+    }
+};
+
+} // namespace
+
 Plotter::Plotter(std::unique_ptr<Canvas> canvas) : canvas_(std::move(canvas))
 {
     if (!canvas_)
@@ -21,17 +48,137 @@ Plotter::Plotter(int width, int height, char background_char)
 {
 }
 
+Plotter::~Plotter() = default;
+
+void Plotter::SetDeferred(const bool deferred)
+{
+    if (!deferred)
+    {
+        FlushDeferred();
+    }
+    deferred_ = deferred;
+}
+
+void Plotter::FlushDeferred() const
+{
+    if (commands_.empty())
+        return;
+
+    const std::vector<DrawCommand> commands = std::move(commands_);
+    commands_.clear();
+
+    // Без пула раскладка по плиткам ничего не дает: команды рисуются по порядку
+    if (!pool_)
+    {
+        for (const DrawCommand& command : commands)
+        {
+            Replay(command, CanvasClip(), *canvas_);
+        }
+        return;
+    }
+
+    // Раскладываем номера команд по плиткам подсчетом: сначала размеры
+    // корзин, затем сами номера, так что в корзине сохраняется порядок записи
+    Canvas& canvas = *canvas_;
+    const int tiles_x = (canvas.Width() + Canvas::kTileSize - 1) >> Canvas::kTileShift;
+    const int tiles_y = (canvas.Height() + Canvas::kTileSize - 1) >> Canvas::kTileShift;
+    const auto for_each_tile = [&](const Rasterizer::ClipRect& bounds, auto&& visit)
+    {
+        for (int tile_y = bounds.y_min >> Canvas::kTileShift; tile_y <= bounds.y_max >> Canvas::kTileShift; ++tile_y)
+        {
+            for (int tile_x = bounds.x_min >> Canvas::kTileShift; tile_x <= bounds.x_max >> Canvas::kTileShift; ++tile_x)
+            {
+                visit(static_cast<size_t>(tile_y) * tiles_x + tile_x);
+            }
+        }
+    };
+
+    std::vector<uint32_t> bin_begin(static_cast<size_t>(tiles_x) * tiles_y + 1, 0);
+    for (const DrawCommand& command : commands)
+    {
+        for_each_tile(command.bounds, [&](const size_t tile) { ++bin_begin[tile + 1]; });
+    }
+    for (size_t tile = 1; tile < bin_begin.size(); ++tile)
+    {
+        bin_begin[tile] += bin_begin[tile - 1];
+    }
+
+    std::vector<uint32_t> bins(bin_begin.back());
+    std::vector<uint32_t> bin_end(bin_begin.begin(), bin_begin.end() - 1);
+    for (uint32_t index = 0; index < commands.size(); ++index)
+    {
+        for_each_tile(commands[index].bounds, [&](const size_t tile) { bins[bin_end[tile]++] = index; });
+    }
+
+    // Полосы выровнены по строкам плиток: строки холста, а с ними и отметки
+    // грязных отрезков, не делятся между потоками
+    ThreadPool::ForEachBand(pool_.get(), canvas.Height(), Canvas::kTileSize, [&](const int y_begin, const int y_end)
+    {
+        for (int tile_y = y_begin >> Canvas::kTileShift; tile_y << Canvas::kTileShift < y_end; ++tile_y)
+        {
+            for (int tile_x = 0; tile_x < tiles_x; ++tile_x)
+            {
+                const size_t tile = static_cast<size_t>(tile_y) * tiles_x + tile_x;
+                const Rasterizer::ClipRect clip = {
+                    tile_x << Canvas::kTileShift,
+                    tile_y << Canvas::kTileShift,
+                    std::min((tile_x + 1) << Canvas::kTileShift, canvas.Width()) - 1,
+                    std::min((tile_y + 1) << Canvas::kTileShift, canvas.Height()) - 1,
+                };
+                for (uint32_t i = bin_begin[tile]; i < bin_end[tile]; ++i)
+                {
+                    Replay(commands[bins[i]], clip, canvas);
+                }
+            }
+        }
+    });
+}
+
+void Plotter::SetThreadCount(int thread_count)
+{
+    if (thread_count <= 0)
+    {
+        thread_count = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    }
+
+    if (thread_count == GetThreadCount())
+        return;
+
+    pool_ = thread_count > 1 ? std::make_unique<ThreadPool>(thread_count) : nullptr;
+}
+
+int Plotter::GetThreadCount() const noexcept
+{
+    return pool_ ? pool_->ThreadCount() : 1;
+}
+
 void Plotter::DrawLine(const int x1, const int y1, const int x2, const int y2,
                        const char brush)
 {
+    BeforeCanvasWrite();
+    if (deferred_)
+    {
+        Defer({DrawCommand::Kind::Line, brush, {x1, y1, x2, y2}, {}},
+              std::min(x1, x2), std::min(y1, y2), std::max(x1, x2), std::max(y1, y2));
+        return;
+    }
+
     DrawLineBresenham(x1, y1, x2, y2, brush);
 }
 
 void Plotter::DrawRectangle(const int x1, const int y1, const int x2,
                             const int y2, const char brush, const bool fill)
 {
+    BeforeCanvasWrite();
     if (fill)
     {
+        if (deferred_)
+        {
+            Defer({DrawCommand::Kind::FilledRectangle, brush, {x1, y1, x2, y2}, {}},
+                  std::min(x1, x2), std::min(y1, y2), std::max(x1, x2), std::max(y1, y2));
+            return;
+        }
+
         canvas_->FillRegion(x1, y1, x2, y2, brush);
     }
     else
@@ -47,8 +194,17 @@ void Plotter::DrawTriangle(const int x1, const int y1, const int x2,
                            const int y2, const int x3, const int y3,
                            const char brush, const bool fill)
 {
+    BeforeCanvasWrite();
     if (fill)
     {
+        if (deferred_)
+        {
+            Defer({DrawCommand::Kind::FilledTriangle, brush, {x1, y1, x2, y2, x3, y3}, {}},
+                  std::min({x1, x2, x3}), std::min({y1, y2, y3}),
+                  std::max({x1, x2, x3}), std::max({y1, y2, y3}));
+            return;
+        }
+
         FillTriangle(x1, y1, x2, y2, x3, y3, brush);
     }
     else
@@ -62,23 +218,22 @@ void Plotter::DrawTriangle(const int x1, const int y1, const int x2,
 void Plotter::DrawCircle(const int center_x, const int center_y,
                          const int radius, const char brush, const bool fill)
 {
+    BeforeCanvasWrite();
+    if (deferred_)
+    {
+        // Контур с отрицательным радиусом рисуется как с |radius|, а с нулевым
+        // задевает и соседние пиксели
+        const long long extent = fill ? std::llabs(radius) : std::max(std::llabs(radius), 1LL);
+        Defer({fill ? DrawCommand::Kind::FilledEllipse : DrawCommand::Kind::CircleOutline, brush,
+               {center_x, center_y, radius, radius}, {}},
+              center_x - extent, center_y - extent, center_x + extent, center_y + extent);
+        return;
+    }
+
     if (fill)
     {
-        for (int y = -radius; y <= radius; ++y)
-        {
-            for (int x = -radius; x <= radius; ++x)
-            {
-                if (x * x + y * y <= radius * radius)
-                {
-                    const int px = center_x + x;
-                    const int py = center_y + y;
-                    if (canvas_->InBounds(px, py))
-                    {
-                        canvas_->at(px, py) = brush;
-                    }
-                }
-            }
-        }
+        Rasterizer::FilledCircle(center_x, center_y, radius, CanvasClip(),
+                                 CanvasWriter{*canvas_, brush});
     }
     else
     {
@@ -86,35 +241,47 @@ void Plotter::DrawCircle(const int center_x, const int center_y,
     }
 }
 
-void Plotter::FloodFill(int x, int y, const char fill_brush)
+void Plotter::DrawEllipse(const int center_x, const int center_y,
+                          const int radius_x, const int radius_y,
+                          const char brush, const bool fill)
 {
-    if (!canvas_->InBounds(x, y))
-        return;
-
-    const char target_brush = canvas_->at(x, y);
-    if (target_brush == fill_brush)
+    BeforeCanvasWrite();
+    if (deferred_)
+    {
+        Defer({fill ? DrawCommand::Kind::FilledEllipse : DrawCommand::Kind::EllipseOutline, brush,
+               {center_x, center_y, radius_x, radius_y}, {}},
+              static_cast<long long>(center_x) - radius_x, static_cast<long long>(center_y) - radius_y,
+              static_cast<long long>(center_x) + radius_x, static_cast<long long>(center_y) + radius_y);
         return;
+    }
 
-    std::queue<std::pair<int, int>> pixels;
-    pixels.emplace(x, y);
-
-    while (!pixels.empty())
+    if (fill)
     {
-        auto [cx, cy] = pixels.front();
-        pixels.pop();
+        Rasterizer::FilledEllipse(center_x, center_y, radius_x, radius_y,
+                                  CanvasClip(), CanvasWriter{*canvas_, brush});
+    }
+    else
+    {
+        Rasterizer::EllipseOutline(center_x, center_y, radius_x, radius_y,
+                                   CanvasClip(), CanvasWriter{*canvas_, brush});
+    }
+}
 
-        if (!canvas_->InBounds(cx, cy) || canvas_->at(cx, cy) != target_brush)
-        {
-            continue;
-        }
+void Plotter::FloodFill(const int x, const int y, const char fill_brush)
+{
+    FlushPending();
+    BeforeCanvasWrite();
+    fill_workspace_.FloodFill(*canvas_, x, y, fill_brush);
+}
 
-        canvas_->at(cx, cy) = fill_brush;
+void Plotter::Submit(const DrawCommandBuffer& commands)
+{
+    ExecuteBatch<char>(*this, commands.Optimized(CanvasClip()));
+}
 
-        pixels.emplace(cx + 1, cy);
-        pixels.emplace(cx - 1, cy);
-        pixels.emplace(cx, cy + 1);
-        pixels.emplace(cx, cy - 1);
-    }
+void Plotter::DrawBatchGradient(const DrawCommandBuffer::Command&)
+{
+    throw std::logic_error("gradients can only be drawn by GrayscalePlotter");
 }
 
 std::map<char, int> Plotter::ColorHistogram() const
@@ -125,21 +292,60 @@ std::map<char, int> Plotter::ColorHistogram() const
 std::map<char, int> Plotter::ColorHistogram(const int x1, const int y1,
                                             const int x2, const int y2) const
 {
-    std::map<char, int> histogram;
+    SyncCanvas();
 
-    for (int y = y1; y <= y2; ++y)
+    const Canvas& canvas = *canvas_;
+    const int left = std::max(x1, 0);
+    const int right = std::min(x2, canvas.Width() - 1);
+    const int top = std::max(y1, 0);
+    const int bottom = std::min(y2, canvas.Height() - 1);
+
+    std::array<int, 256> counts{};
+    std::vector<char> row(std::max(right - left + 1, 0));
+    for (int y = top; y <= bottom && left <= right; ++y)
     {
-        for (int x = x1; x <= x2; ++x)
+        canvas.ReadRow(left, y, static_cast<int>(row.size()), row.data());
+        for (const char color : row)
         {
-            if (canvas_->InBounds(x, y))
-            {
-                char color = canvas_->at(x, y);
-                histogram[color]++;
-            }
+            counts[static_cast<unsigned char>(color)]++;
         }
     }
 
-    return histogram;
+    return HistogramFromCounts(counts);
+}
+
+std::map<char, int> Plotter::ColorHistogram(const ConstCanvasView view)
+{
+    std::array<int, 256> counts{};
+    for (int y = 0; y < view.Height(); ++y)
+    {
+        const char* row = view.Row(y);
+        for (int x = 0; x < view.Width(); ++x)
+        {
+            counts[static_cast<unsigned char>(row[x])]++;
+        }
+    }
+
+    return HistogramFromCounts(counts);
+}
+
+HistogramIndex::Counts Plotter::ColorCounts(const int x1, const int y1, const int x2, const int y2) const
+{
+    return Histograms().Histogram(x1, y1, x2, y2);
+}
+
+[[nodiscard]] const HistogramIndex& Plotter::Histograms() const
+{
+    SyncCanvas();
+    if (!histograms_)
+    {
+        histograms_ = std::make_unique<HistogramIndex>(*canvas_);
+    }
+    else
+    {
+        histograms_->Refresh(*canvas_);
+    }
+    return *histograms_;
 }
 
 std::pair<char, char>
@@ -175,298 +381,234 @@ Plotter::MinMaxColors(const std::map<char, int>& color_weights)
 std::unique_ptr<Canvas> Plotter::ExtractRegion(const int x1, const int y1,
                                                const int x2, const int y2) const
 {
+    SyncCanvas();
+
     int width = x2 - x1 + 1;
     int height = y2 - y1 + 1;
 
+    const Canvas& canvas = *canvas_;
     auto region = std::make_unique<Canvas>(width, height, ' ');
 
-    for (int y = 0; y < height; ++y)
+    // Видимая часть копируется построчно, остальное остается фоном
+    const int left = std::max(x1, 0);
+    const int right = std::min(x2, canvas.Width() - 1);
+    const int top = std::max(y1, 0);
+    const int bottom = std::min(y2, canvas.Height() - 1);
+
+    for (int y = top; y <= bottom && left <= right; ++y)
     {
-        for (int x = 0; x < width; ++x)
-        {
-            const int src_x = x1 + x;
-            const int src_y = y1 + y;
-            if (canvas_->InBounds(src_x, src_y))
-            {
-                region->at(x, y) = canvas_->at(src_x, src_y);
-            }
-        }
+        canvas.ReadRow(left, y, right - left + 1, region->Row(y - y1).data() + (left - x1));
     }
 
     return region;
 }
 
+ConstCanvasView Plotter::ViewRegion(const int x1, const int y1, const int x2,
+                                    const int y2) const
+{
+    SyncCanvas();
+    return std::as_const(*canvas_).View(x1, y1, x2 - x1 + 1, y2 - y1 + 1);
+}
+
 void Plotter::PasteRegion(const Canvas& region, const int x, const int y)
 {
+    if (!region.IsTiled())
+    {
+        PasteRegion(region.View(), x, y);
+        return;
+    }
+
+    std::vector<char> row(region.Width());
     for (int ry = 0; ry < region.Height(); ++ry)
     {
-        for (int rx = 0; rx < region.Width(); ++rx)
-        {
-            const int dest_x = x + rx;
-            const int dest_y = y + ry;
-            if (canvas_->InBounds(dest_x, dest_y))
-            {
-                (*canvas_)(dest_x, dest_y) = region.at(rx, ry);
-            }
-        }
+        region.ReadRow(0, ry, region.Width(), row.data());
+        PasteRegion(ConstCanvasView(row.data(), region.Width(), 1, region.Width()), x, y + ry);
     }
 }
 
-void Plotter::DrawLineBresenham(int x1, int y1, const int x2, const int y2,
-                                const char brush)
+void Plotter::PasteRegion(const ConstCanvasView region, const int x, const int y)
 {
-    int dx = std::abs(x2 - x1);
-    int dy = std::abs(y2 - y1);
-    const int sx = x1 < x2 ? 1 : -1;
-    const int sy = y1 < y2 ? 1 : -1;
-    int err = dx - dy;
+    FlushPending();
+    BeforeCanvasWrite();
+    const int left = std::max(x, 0);
+    const int right = std::min(x + region.Width(), canvas_->Width());
+    const int top = std::max(y, 0);
+    const int bottom = std::min(y + region.Height(), canvas_->Height());
+    if (left >= right || top >= bottom)
+        return;
 
-    while (true)
+    // Окно может указывать в этот же холст: если приемник ниже источника,
+    // строки копируются снизу вверх, чтобы не затереть еще не скопированные
+    const bool bottom_up = !canvas_->IsTiled() &&
+        std::greater<const char*>()(std::as_const(*canvas_).Row(top).data(), region.Row(top - y));
+    for (int i = 0; i < bottom - top; ++i)
     {
-        if (canvas_->InBounds(x1, y1))
-        {
-            (*canvas_)(x1, y1) = brush;
-        }
-
-        if (x1 == x2 && y1 == y2)
-            break;
-
-        int e2 = 2 * err;
-        if (e2 > -dy)
-        {
-            err -= dy;
-            x1 += sx;
-        }
-        if (e2 < dx)
-        {
-            err += dx;
-            y1 += sy;
-        }
+        const int dest_y = bottom_up ? bottom - 1 - i : top + i;
+        canvas_->WriteRow(left, dest_y, right - left, region.Row(dest_y - y) + (left - x));
     }
 }
 
+void Plotter::DrawLineBresenham(const int x1, const int y1, const int x2,
+                                const int y2, const char brush)
+{
+    Rasterizer::Line(x1, y1, x2, y2, CanvasClip(), CanvasWriter{*canvas_, brush});
+}
+
 void Plotter::DrawCircleBresenham(const int center_x, const int center_y,
                                   const int radius, const char brush)
 {
+    Rasterizer::CircleOutline(center_x, center_y, radius, CanvasClip(),
+                              CanvasWriter{*canvas_, brush});
+}
 
-    auto draw_circle_points =
-        [&](const int cx, const int cy, const int x, const int y)
-    {
-        if (canvas_->InBounds(cx + x, cy + y))
-            (*canvas_)(cx + x, cy + y) = brush;
-        if (canvas_->InBounds(cx - x, cy + y))
-            (*canvas_)(cx - x, cy + y) = brush;
-        if (canvas_->InBounds(cx + x, cy - y))
-            (*canvas_)(cx + x, cy - y) = brush;
-        if (canvas_->InBounds(cx - x, cy - y))
-            (*canvas_)(cx - x, cy - y) = brush;
-        if (canvas_->InBounds(cx + y, cy + x))
-            (*canvas_)(cx + y, cy + x) = brush;
-        if (canvas_->InBounds(cx - y, cy + x))
-            (*canvas_)(cx - y, cy + x) = brush;
-        if (canvas_->InBounds(cx + y, cy - x))
-            (*canvas_)(cx + y, cy - x) = brush;
-        if (canvas_->InBounds(cx - y, cy - x))
-            (*canvas_)(cx - y, cy - x) = brush;
-    };
-
-    int x = 0;
-    int y = radius;
-    int d = 3 - 2 * radius;
+void Plotter::FillTriangle(const int x1, const int y1, const int x2,
+                           const int y2, const int x3, const int y3,
+                           const char brush) const
+{
+    Rasterizer::FilledTriangle(x1, y1, x2, y2, x3, y3, CanvasClip(),
+                               CanvasWriter{*canvas_, brush});
+}
 
-    draw_circle_points(center_x, center_y, x, y);
+bool Plotter::Present(TerminalRenderer& terminal) const
+{
+    SyncCanvas();
+    return terminal.Present(*canvas_);
+}
 
-    while (y >= x)
+std::map<char, int> Plotter::HistogramFromCounts(const std::array<int, 256>& counts)
+{
+    std::map<char, int> histogram;
+    for (size_t c = 0; c < counts.size(); ++c)
     {
-        x++;
-        if (d > 0)
+        if (counts[c] > 0)
         {
-            --y;
-            d = d + 4 * (x - y) + 10;
+            histogram[static_cast<char>(c)] = counts[c];
         }
-        else
-        {
-            d = d + 4 * x + 6;
-        }
-        draw_circle_points(center_x, center_y, x, y);
     }
+    return histogram;
 }
 
-void Plotter::FillTriangle(int x1, int y1, int x2, int y2, int x3, int y3,
-                           const char brush) const
+Rasterizer::ClipRect Plotter::CanvasClip() const noexcept
 {
-    const int min_x = std::min({x1, x2, x3});
-    const int max_x = std::max({x1, x2, x3});
-    const int min_y = std::min({y1, y2, y3});
-    const int max_y = std::max({y1, y2, y3});
-
-    auto edge_function = [](const int x1_, const int y1_, const int x2_,
-                            const int y2_, const int x, const int y)
-    { return (x - x1_) * (y2_ - y1_) - (y - y1_) * (x2_ - x1_); };
+    return {0, 0, canvas_->Width() - 1, canvas_->Height() - 1};
+}
 
-    for (int y = min_y; y <= max_y; ++y)
+// Команда, не задевающая холст, ничего бы не нарисовала и не записывается
+void Plotter::Defer(DrawCommand command, const long long left, const long long top, const long long right,
+                    const long long bottom)
+{
+    const Rasterizer::ClipRect clip = CanvasClip();
+    command.bounds = {
+        static_cast<int>(std::max<long long>(left, clip.x_min)),
+        static_cast<int>(std::max<long long>(top, clip.y_min)),
+        static_cast<int>(std::min<long long>(right, clip.x_max)),
+        static_cast<int>(std::min<long long>(bottom, clip.y_max)),
+    };
+    if (!command.bounds.Empty())
     {
-        for (int x = min_x; x <= max_x; ++x)
-        {
-            if (!canvas_->InBounds(x, y))
-            {
-                continue;
-            }
-
-            bool inside = true;
-            inside &= edge_function(x1, y1, x2, y2, x, y) >= 0;
-            inside &= edge_function(x2, y2, x3, y3, x, y) >= 0;
-            inside &= edge_function(x3, y3, x1, y1, x, y) >= 0;
-
-            if (inside)
-            {
-                (*canvas_)(x, y) = brush;
-            }
-        }
+        commands_.push_back(command);
     }
 }
 
-void Plotter::ScanlineFill(const int x, const int y, const char fill_brush)
+void Plotter::Replay(const DrawCommand& command, const Rasterizer::ClipRect& clip, Canvas& canvas)
 {
-    if (!canvas_->InBounds(x, y))
+    const int* c = command.coords;
+    const CanvasWriter writer{canvas, command.brush};
+    switch (command.kind)
     {
-        return;
+    case DrawCommand::Kind::Line:
+        Rasterizer::Line(c[0], c[1], c[2], c[3], clip, writer);
+        break;
+    case DrawCommand::Kind::FilledRectangle:
+        // Одной заливкой: плиточный холст накрытую целиком плитку делает однородной
+        canvas.FillRegion(std::max({std::min(c[0], c[2]), clip.x_min}), std::max({std::min(c[1], c[3]), clip.y_min}),
+                          std::min({std::max(c[0], c[2]), clip.x_max}), std::min({std::max(c[1], c[3]), clip.y_max}),
+                          command.brush);
+        break;
+    case DrawCommand::Kind::FilledTriangle:
+        Rasterizer::FilledTriangle(c[0], c[1], c[2], c[3], c[4], c[5], clip, writer);
+        break;
+    case DrawCommand::Kind::CircleOutline:
+        Rasterizer::CircleOutline(c[0], c[1], c[2], clip, writer);
+        break;
+    case DrawCommand::Kind::FilledEllipse:
+        Rasterizer::FilledEllipse(c[0], c[1], c[2], c[3], clip, writer);
+        break;
+    case DrawCommand::Kind::EllipseOutline:
+        Rasterizer::EllipseOutline(c[0], c[1], c[2], c[3], clip, writer);
+        break;
     }
+}
 
-    const char target_brush = (*canvas_)(x, y);
-    if (target_brush == fill_brush)
+[[nodiscard]] const RegionLabels& Plotter::Regions() const
+{
+    SyncCanvas();
+    if (!regions_ || !regions_->IsCurrent(*canvas_))
     {
-        return;
+        regions_ = std::make_unique<RegionLabels>(*canvas_, pool_.get());
     }
+    return *regions_;
+}
 
-    std::stack<ScanlineSegment> segments;
-
-    // Находим начальный горизонтальный отрезок
-    int x_start = x;
-    int x_end = x;
-
-    // Идем влево
-    while (x_start >= 0 && canvas_->at(x_start, y) == target_brush)
+void Plotter::FillRegions(const std::span<const std::pair<int, int>> seeds, const char fill_brush)
+{
+    const RegionLabels& regions = Regions();
+    std::vector<char> selected(regions.RegionCount(), 0);
+    bool any = false;
+    for (const auto& [x, y] : seeds)
     {
-        x_start--;
+        if (!canvas_->InBounds(x, y))
+        {
+            continue;
+        }
+        const uint32_t label = regions.Label(x, y);
+        if (regions.RegionChar(label) != fill_brush)
+        {
+            selected[label] = 1;
+            any = true;
+        }
     }
-    x_start++;
 
-    // Идем вправо
-    while (x_end < canvas_->Width() && canvas_->at(x_end, y) == target_brush)
+    if (any)
     {
-        x_end++;
+        FillSelectedRegions(regions, selected, fill_brush);
     }
-    x_end--;
+}
 
-    // Закрашиваем начальный отрезок
-    for (int i = x_start; i <= x_end; i++)
+void Plotter::FillEnclosedRegions(const char target_brush, const char fill_brush)
+{
+    if (target_brush == fill_brush)
     {
-        canvas_->at(i, y) = fill_brush;
+        return;
     }
 
-    // Добавляем сегменты сверху и снизу
-    if (y > 0)
+    const RegionLabels& regions = Regions();
+    std::vector<char> selected(regions.RegionCount(), 0);
+    bool any = false;
+    for (uint32_t label = 0; label < regions.RegionCount(); ++label)
     {
-        segments.emplace(y - 1, x_start, x_end);
-    }
-    if (y < canvas_->Height() - 1)
-    {
-        segments.emplace(y + 1, x_start, x_end);
+        selected[label] = regions.RegionChar(label) == target_brush && regions.IsEnclosed(label);
+        any = any || selected[label];
     }
 
-    while (!segments.empty())
+    if (any)
     {
-        const auto [y, x_start, x_end] = segments.top();
-        segments.pop();
-
-        const int current_y = y;
-        int current_x = x_start;
-
-        while (current_x <= x_end)
-        {
-            // Пропускаем уже закрашенные или неподходящие пиксели
-            if (canvas_->at(current_x, current_y) != target_brush)
-            {
-                current_x++;
-                continue;
-            }
-
-            // Находим начало нового отрезка
-            int new_x_start = current_x;
-            while (new_x_start > 0 &&
-                   canvas_->at(new_x_start - 1, current_y) == target_brush)
-            {
-                new_x_start--;
-            }
-
-            // Находим конец отрезка
-            int new_x_end = current_x;
-            while (new_x_end < canvas_->Width() - 1 &&
-                   canvas_->at(new_x_end + 1, current_y) == target_brush)
-            {
-                new_x_end++;
-            }
-
-            // Закрашиваем отрезок
-            for (int i = new_x_start; i <= new_x_end; i++)
-            {
-                canvas_->at(i, current_y) = fill_brush;
-            }
-
-            // Проверяем соседние строки на наличие новых сегментов
-            if (current_y > 0)
-            {
-                // Для строки выше проверяем, есть ли непрерывные отрезки
-                int above_y = current_y - 1;
-                int above_x = new_x_start;
-                while (above_x <= new_x_end)
-                {
-                    if (canvas_->at(above_x, above_y) == target_brush)
-                    {
-                        int above_start = above_x;
-                        while (above_x <= new_x_end &&
-                               canvas_->at(above_x, above_y) == target_brush)
-                        {
-                            above_x++;
-                        }
-                        segments.emplace(above_y, above_start, above_x - 1);
-                    }
-                    else
-                    {
-                        above_x++;
-                    }
-                }
-            }
+        FillSelectedRegions(regions, selected, fill_brush);
+    }
+}
 
-            if (current_y < canvas_->Height() - 1)
-            {
-                // Для строки ниже проверяем, есть ли непрерывные отрезки
-                int below_y = current_y + 1;
-                int below_x = new_x_start;
-                while (below_x <= new_x_end)
-                {
-                    if (canvas_->at(below_x, below_y) == target_brush)
-                    {
-                        int below_start = below_x;
-                        while (below_x <= new_x_end &&
-                               canvas_->at(below_x, below_y) == target_brush)
-                        {
-                            below_x++;
-                        }
-                        segments.emplace(below_y, below_start, below_x - 1);
-                    }
-                    else
-                    {
-                        below_x++;
-                    }
-                }
-            }
+void Plotter::FillSelectedRegions(const RegionLabels& regions, const std::vector<char>& selected,
+                                  const char fill_brush)
+{
+    regions.ForEachSelectedRun(selected, pool_.get(), [&](const int y, const int x_begin, const int x_end)
+        { canvas_->FillRegion(x_begin, y, x_end, y, fill_brush); });
+}
 
-            // Переходим к следующему потенциальному отрезку
-            current_x = new_x_end + 1;
-        }
-    }
+void Plotter::ScanlineFill(const int x, const int y, const char fill_brush)
+{
+    FlushPending();
+    BeforeCanvasWrite();
+    fill_workspace_.ScanlineFill(*canvas_, x, y, fill_brush);
 }
 
 } // namespace plotter
\ No newline at end of file
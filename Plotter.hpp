@@ -1,52 +1,223 @@
 #pragma once
 #include "Canvas.hpp"
+#include "DrawCommandBuffer.hpp"
+#include "FillWorkspace.hpp"
+#include "HistogramIndex.hpp"
+#include "Rasterizer.hpp"
+#include "RegionLabels.hpp"
+#include <array>
+#include <cstdint>
 #include <map>
 #include <memory>
+#include <span>
+#include <utility>
+#include <vector>
 
 namespace plotter
 {
 
+class TerminalRenderer;
+class ThreadPool;
+
 class Plotter
 {
 public:
     explicit Plotter(std::unique_ptr<Canvas> canvas);
     Plotter(int width, int height, char background_char = ' ');
+    virtual ~Plotter();
 
     void DrawLine(int x1, int y1, int x2, int y2, char brush);
     void DrawRectangle(int x1, int y1, int x2, int y2, char brush, bool fill = false);
     void DrawTriangle(int x1, int y1, int x2, int y2, int x3, int y3, char brush, bool fill = false);
     void DrawCircle(int center_x, int center_y, int radius, char brush, bool fill = false);
+    void DrawEllipse(int center_x, int center_y, int radius_x, int radius_y, char brush, bool fill = false);
 
     void FloodFill(int x, int y, char fill_brush);
     void ScanlineFill(int x, int y, char fill_brush);
 
+    // Разметка связных областей холста. Строится на пуле потоков и
+    // переиспользуется, пока холст не изменился
+    [[nodiscard]] const RegionLabels& Regions() const;
+    // Заливает области всех точек seeds за один проход. Точки ищутся на
+    // холсте до заливки, поэтому область, слившаяся с соседней после
+    // заливки, не расширяется, как при цепочке вызовов ScanlineFill
+    void FillRegions(std::span<const std::pair<int, int>> seeds, char fill_brush);
+    // Заливает все области символа target_brush, не касающиеся края холста
+    void FillEnclosedRegions(char target_brush, char fill_brush);
+
+    // Рисует весь пакет одним вызовом после DrawCommandBuffer::Optimized.
+    // Значения команд - коды символов кисти; градиенты рисует только
+    // GrayscalePlotter, здесь они бросают std::logic_error
+    void Submit(const DrawCommandBuffer& commands);
+
     [[nodiscard]] std::map<char, int> ColorHistogram() const;
     [[nodiscard]] std::map<char, int> ColorHistogram(int x1, int y1, int x2, int y2) const;
+    [[nodiscard]] static std::map<char, int> ColorHistogram(ConstCanvasView view);
+    // Гистограмма прямоугольника плоским массивом по индексу HistogramIndex
+    // за O(числа символов холста) при любом выравнивании окна. Индекс
+    // строится при первом запросе, а после изменения холста пересчитывает
+    // только таблицы символов измененных строк ниже первой из них;
+    // проверка, что холст не менялся, стоит O(1)
+    [[nodiscard]] HistogramIndex::Counts ColorCounts(int x1, int y1, int x2, int y2) const;
+    [[nodiscard]] const HistogramIndex& Histograms() const;
     [[nodiscard]] static std::pair<char, char> MinMaxColors(const std::map<char, int>& color_weights);
 
     [[nodiscard]] std::unique_ptr<Canvas> ExtractRegion(int x1, int y1, int x2, int y2) const;
+    // Окно в холст без копирования, обрезанное по его границам
+    [[nodiscard]] ConstCanvasView ViewRegion(int x1, int y1, int x2, int y2) const;
     void PasteRegion(const Canvas& region, int x, int y);
+    void PasteRegion(ConstCanvasView region, int x, int y);
+
+    // Отложенное рисование: линии, прямоугольники, треугольники, круги и
+    // эллипсы записываются в список команд. FlushDeferred раскладывает их по
+    // плиткам холста и растеризует плитки параллельно; каждая плитка
+    // повторяет свои команды в порядке записи, поэтому результат совпадает с
+    // немедленным рисованием. Перед любым чтением холста, в том числе через
+    // GetCanvas, и перед заливками и вставкой команды рисуются сами
+    void SetDeferred(bool deferred);
+    [[nodiscard]] bool IsDeferred() const noexcept { return deferred_; }
+    void FlushDeferred() const;
+
+    // 0 - по числу аппаратных потоков
+    void SetThreadCount(int thread_count);
+    [[nodiscard]] int GetThreadCount() const noexcept;
 
-    [[nodiscard]] const Canvas& GetCanvas() const noexcept { return *canvas_; }
-    Canvas& GetCanvas() noexcept { return *canvas_; }
+    // Холст после отложенных команд и буферов наследника (SyncCanvas).
+    // ВНИМАНИЕ: константные методы чтения (GetCanvas, Render, SaveToFile,
+    // ColorHistogram, Regions и т. п.) при включенном отложенном рисовании
+    // или буфере яркости GrayscalePlotter пишут в холст: рисуют отложенные
+    // команды и переводят буфер в символы. Поэтому одновременно вызывать их
+    // из нескольких потоков в этих режимах нельзя даже через const Plotter&;
+    // без отложенных команд и буфера они только читают
+    [[nodiscard]] const Canvas& GetCanvas() const
+    {
+        SyncCanvas();
+        return *canvas_;
+    }
+    Canvas& GetCanvas()
+    {
+        SyncCanvas();
+        return *canvas_;
+    }
 
-    void Render(std::ostream& os = std::cout) const { canvas_->Render(os); }
-    void SaveToFile(const std::filesystem::path& filepath) const { canvas_->SaveToFile(filepath); }
+    void Render(std::ostream& os = std::cout) const { SyncCanvas(); canvas_->Render(os); }
+    void RenderToFd(int fd) const { SyncCanvas(); canvas_->RenderToFd(fd); }
+    bool Present(TerminalRenderer& terminal) const;
+    void SaveToFile(const std::filesystem::path& filepath) const { SyncCanvas(); canvas_->SaveToFile(filepath); }
     void SaveToFile(const std::string& filename) const { SaveToFile(std::filesystem::path(filename)); }
+    void SaveToFile(const std::filesystem::path& filepath, Canvas::FileFormat format, bool row_index = false) const
+    {
+        SyncCanvas();
+        canvas_->SaveToFile(filepath, format, row_index);
+    }
+
+protected:
+    // Приводит холст в актуальное состояние перед его чтением
+    virtual void SyncCanvas() const { FlushPending(); }
+    // Вызывается методами Plotter перед записью символов в холст, в том числе
+    // перед записью отложенной команды: наследник с собственным буфером
+    // успевает перенести в холст то, что было нарисовано раньше
+    virtual void BeforeCanvasWrite() {}
+    // Холст без синхронизации: для размеров и для записи самим наследником
+    Canvas& RawCanvas() const noexcept { return *canvas_; }
+    [[nodiscard]] Rasterizer::ClipRect CanvasClip() const noexcept;
+    [[nodiscard]] ThreadPool* Pool() const noexcept { return pool_.get(); }
+    // Выполняет уже оптимизированный пакет методами target: Paint - тип
+    // значения команды в его перегрузках (char у Plotter, double у
+    // GrayscalePlotter). Градиенты уходят в виртуальный DrawBatchGradient
+    template <typename Paint, typename Target>
+    static void ExecuteBatch(Target& target, const DrawCommandBuffer& batch);
+    virtual void DrawBatchGradient(const DrawCommandBuffer::Command& command);
 
 private:
+    // Примитив отложенного рисования. Контуры прямоугольника и треугольника
+    // записываются отрезками, как и рисуются
+    struct DrawCommand
+    {
+        enum class Kind : uint8_t
+        {
+            Line,
+            FilledRectangle,
+            FilledTriangle,
+            CircleOutline,
+            FilledEllipse,
+            EllipseOutline,
+        };
+
+        Kind kind;
+        char brush;
+        int coords[6];
+        // Охватывающий прямоугольник, уже обрезанный по холсту
+        Rasterizer::ClipRect bounds;
+    };
+
     std::unique_ptr<Canvas> canvas_;
+    std::unique_ptr<ThreadPool> pool_;
+    bool deferred_ = false;
+    mutable std::vector<DrawCommand> commands_;
+    mutable std::unique_ptr<RegionLabels> regions_;
+    mutable std::unique_ptr<HistogramIndex> histograms_;
+    FillWorkspace fill_workspace_;
+
+    void FlushPending() const
+    {
+        if (!commands_.empty())
+        {
+            FlushDeferred();
+        }
+    }
+    void Defer(DrawCommand command, long long left, long long top, long long right, long long bottom);
+    static void Replay(const DrawCommand& command, const Rasterizer::ClipRect& clip, Canvas& canvas);
+    void FillSelectedRegions(const RegionLabels& regions, const std::vector<char>& selected, char fill_brush);
 
     void DrawLineBresenham(int x1, int y1, int x2, int y2, char brush);
     void DrawCircleBresenham(int center_x, int center_y, int radius, char brush);
     void FillTriangle(int x1, int y1, int x2, int y2, int x3, int y3, char brush) const;
+    static std::map<char, int> HistogramFromCounts(const std::array<int, 256>& counts);
+};
 
-    struct ScanlineSegment
+template <typename Paint, typename Target>
+void Plotter::ExecuteBatch(Target& target, const DrawCommandBuffer& batch)
+{
+    using Op = DrawCommandBuffer::Op;
+    for (size_t i = 0; i < batch.Size(); ++i)
     {
-        int y;
-        int x_start;
-        int x_end;
-    };
-};
+        const DrawCommandBuffer::Command command = batch[i];
+        const int* c = command.coords;
+        const Paint paint = command.op == Op::Paste ? Paint{} : static_cast<Paint>(command.values[0]);
+        switch (command.op)
+        {
+        case Op::Line:
+            target.DrawLine(c[0], c[1], c[2], c[3], paint);
+            break;
+        case Op::Rectangle:
+        case Op::FilledRectangle:
+            target.DrawRectangle(c[0], c[1], c[2], c[3], paint, command.op == Op::FilledRectangle);
+            break;
+        case Op::Triangle:
+        case Op::FilledTriangle:
+            target.DrawTriangle(c[0], c[1], c[2], c[3], c[4], c[5], paint, command.op == Op::FilledTriangle);
+            break;
+        case Op::Circle:
+        case Op::FilledCircle:
+            target.DrawCircle(c[0], c[1], c[2], paint, command.op == Op::FilledCircle);
+            break;
+        case Op::Ellipse:
+        case Op::FilledEllipse:
+            target.DrawEllipse(c[0], c[1], c[2], c[3], paint, command.op == Op::FilledEllipse);
+            break;
+        case Op::Fill:
+            target.ScanlineFill(c[0], c[1], paint);
+            break;
+        case Op::LinearGradient:
+        case Op::RadialGradient:
+            static_cast<Plotter&>(target).DrawBatchGradient(command);
+            break;
+        case Op::Paste:
+            target.PasteRegion(batch.Source(command), c[0], c[1]);
+            break;
+        }
+    }
+}
 
 } // namespace plotter
\ No newline at end of file
@@ -12,14 +12,20 @@ class PlotterFactory
 public:
     static std::unique_ptr<Plotter> CreatePlotter(const PlotterConfig& config)
     {
+        const auto storage = config.storage == "tiled" ? Canvas::Storage::Tiled : Canvas::Storage::Dense;
+        auto canvas = std::make_unique<Canvas>(config.width, config.height, config.background_char, storage);
+
+        std::unique_ptr<Plotter> plotter;
         if (config.plotter_type == "grayscale")
         {
-            return std::make_unique<GrayscalePlotter>(config.width, config.height, config.background_char, config.palette);
+            plotter = std::make_unique<GrayscalePlotter>(std::move(canvas), config.palette);
         }
         else
         {
-            return std::make_unique<Plotter>(config.width, config.height, config.background_char);
+            plotter = std::make_unique<Plotter>(std::move(canvas));
         }
+        plotter->SetThreadCount(config.thread_count);
+        return plotter;
     }
 };
 
@@ -0,0 +1,442 @@
+#pragma once
+#include <algorithm>
+#include <cstdlib>
+#include <type_traits>
+#include <utility>
+
+namespace plotter
+{
+
+class Rasterizer
+{
+public:
+    struct ClipRect
+    {
+        int x_min;
+        int y_min;
+        int x_max;
+        int y_max;
+
+        [[nodiscard]] bool Contains(const int x, const int y) const noexcept
+        {
+            return x >= x_min && x <= x_max && y >= y_min && y <= y_max;
+        }
+
+        [[nodiscard]] bool Empty() const noexcept
+        {
+            return x_min > x_max || y_min > y_max;
+        }
+    };
+
+    // Отрезок Брезенхема, заранее обрезанный по clip: внутренний цикл идет
+    // только по видимым шагам и не проверяет границы. Если writer умеет
+    // заливать отрезки строки (y, x_begin, x_end), горизонтальная линия
+    // пишется одной заливкой
+    template <typename PlotPixel>
+    static void Line(const int x1, const int y1, const int x2, const int y2,
+                     const ClipRect& clip, PlotPixel plot)
+    {
+        const long long dx = std::llabs(static_cast<long long>(x2) - x1);
+        const long long dy = std::llabs(static_cast<long long>(y2) - y1);
+        const int sx = x1 < x2 ? 1 : -1;
+        const int sy = y1 < y2 ? 1 : -1;
+
+        if (dy == 0)
+        {
+            if (y1 < clip.y_min || y1 > clip.y_max)
+                return;
+
+            const int left = std::max(std::min(x1, x2), clip.x_min);
+            const int right = std::min(std::max(x1, x2), clip.x_max);
+            if constexpr (std::is_invocable_v<PlotPixel&, int, int, int>)
+            {
+                if (left <= right)
+                    plot(y1, left, right);
+            }
+            else
+            {
+                for (int x = left; x <= right; ++x)
+                    plot(x, y1);
+            }
+            return;
+        }
+
+        if (dx == 0)
+        {
+            if (x1 < clip.x_min || x1 > clip.x_max)
+                return;
+
+            const int top = std::max(std::min(y1, y2), clip.y_min);
+            const int bottom = std::min(std::max(y1, y2), clip.y_max);
+            for (int y = top; y <= bottom; ++y)
+                plot(x1, y);
+            return;
+        }
+
+        // Вдоль главной оси координата меняется на каждом шаге, вдоль
+        // второстепенной - после minor(k) = ceil((2k * d - D) / 2D) шагов из k.
+        // Обе монотонны, поэтому видимые шаги образуют один отрезок [first, last]
+        const bool x_major = dx >= dy;
+        const long long major = x_major ? dx : dy;
+        const long long minor = x_major ? dy : dx;
+
+        const auto [major_begin, major_end] = x_major
+            ? StepRange(x1, sx, clip.x_min, clip.x_max, major)
+            : StepRange(y1, sy, clip.y_min, clip.y_max, major);
+        const auto [minor_begin, minor_end] = x_major
+            ? StepRange(y1, sy, clip.y_min, clip.y_max, minor)
+            : StepRange(x1, sx, clip.x_min, clip.x_max, minor);
+        if (major_begin > major_end || minor_begin > minor_end)
+            return;
+
+        const long long first = std::max(major_begin, FloorDiv(2 * major * minor_begin - major, 2 * minor) + 1);
+        const long long last = std::min(major_end, FloorDiv(2 * major * minor_end + major, 2 * minor));
+        if (first > last)
+            return;
+
+        // Восстанавливаем состояние алгоритма на шаге first
+        const long long minor_steps = -FloorDiv(major - 2 * first * minor, 2 * major);
+        const long long x_steps = x_major ? first : minor_steps;
+        const long long y_steps = x_major ? minor_steps : first;
+        int x = static_cast<int>(x1 + sx * x_steps);
+        int y = static_cast<int>(y1 + sy * y_steps);
+        long long err = dx - dy - x_steps * dy + y_steps * dx;
+
+        for (long long remaining = last - first;; --remaining)
+        {
+            plot(x, y);
+
+            if (remaining == 0)
+                break;
+
+            const long long e2 = 2 * err;
+            if (e2 > -dy)
+            {
+                err -= dy;
+                x += sx;
+            }
+            if (e2 < dx)
+            {
+                err += dx;
+                y += sy;
+            }
+        }
+    }
+
+    template <typename PlotPixel>
+    static void CircleOutline(const int center_x, const int center_y,
+                              const int radius, const ClipRect& clip,
+                              PlotPixel plot)
+    {
+        auto plot_octants = [&](const int x, const int y)
+        {
+            const int points[8][2] = {
+                {center_x + x, center_y + y}, {center_x - x, center_y + y},
+                {center_x + x, center_y - y}, {center_x - x, center_y - y},
+                {center_x + y, center_y + x}, {center_x - y, center_y + x},
+                {center_x + y, center_y - x}, {center_x - y, center_y - x},
+            };
+            for (const auto& [px, py] : points)
+            {
+                if (clip.Contains(px, py))
+                    plot(px, py);
+            }
+        };
+
+        int x = 0;
+        int y = radius;
+        int d = 3 - 2 * radius;
+
+        plot_octants(x, y);
+
+        while (y >= x)
+        {
+            x++;
+            if (d > 0)
+            {
+                --y;
+                d = d + 4 * (x - y) + 10;
+            }
+            else
+            {
+                d = d + 4 * x + 6;
+            }
+            plot_octants(x, y);
+        }
+    }
+
+    template <typename FillSpan>
+    static void FilledCircle(const int center_x, const int center_y,
+                             const int radius, const ClipRect& clip,
+                             FillSpan fill)
+    {
+        FilledEllipse(center_x, center_y, radius, radius, clip, fill);
+    }
+
+    template <typename FillSpan>
+    static void FilledEllipse(const int center_x, const int center_y,
+                              const int radius_x, const int radius_y,
+                              const ClipRect& clip, FillSpan fill)
+    {
+        if (radius_x < 0 || radius_y < 0)
+            return;
+
+        // Полуширина строки y - наибольший x, для которого
+        // x^2 * ry^2 + y^2 * rx^2 <= rx^2 * ry^2; с ростом |y| она только
+        // уменьшается, поэтому считается инкрементально. Произведения
+        // четвертой степени радиуса не помещаются в 64 бита уже при
+        // радиусах около 55000, поэтому считаются в WideInt
+        const WideInt rx2 = static_cast<WideInt>(radius_x) * radius_x;
+        const WideInt ry2 = static_cast<WideInt>(radius_y) * radius_y;
+        const WideInt limit = rx2 * ry2;
+        long long half_width = radius_x;
+
+        auto fill_row = [&](const long long y)
+        {
+            if (y < clip.y_min || y > clip.y_max)
+                return;
+
+            const long long span_begin = std::max<long long>(center_x - half_width, clip.x_min);
+            const long long span_end = std::min<long long>(center_x + half_width, clip.x_max);
+            if (span_begin <= span_end)
+            {
+                fill(static_cast<int>(y), static_cast<int>(span_begin), static_cast<int>(span_end));
+            }
+        };
+
+        for (long long dy = 0; dy <= radius_y; ++dy)
+        {
+            while (half_width >= 0
+                   && static_cast<WideInt>(half_width) * half_width * ry2 + static_cast<WideInt>(dy) * dy * rx2 > limit)
+            {
+                --half_width;
+            }
+            if (half_width < 0)
+                break;
+
+            fill_row(center_y - dy);
+            if (dy != 0)
+            {
+                fill_row(center_y + dy);
+            }
+        }
+    }
+
+    template <typename PlotPixel>
+    static void EllipseOutline(const int center_x, const int center_y,
+                               const int radius_x, const int radius_y,
+                               const ClipRect& clip, PlotPixel plot)
+    {
+        if (radius_x < 0 || radius_y < 0)
+            return;
+
+        if (radius_x == 0 || radius_y == 0)
+        {
+            // Вырожденный эллипс - отрезок, совпадающий с его заливкой
+            FilledEllipse(center_x, center_y, radius_x, radius_y, clip,
+                          [&](const int y, const int x_begin, const int x_end)
+                          {
+                              for (int x = x_begin; x <= x_end; ++x)
+                                  plot(x, y);
+                          });
+            return;
+        }
+
+        auto plot_quadrants = [&](const long long x, const long long y)
+        {
+            const long long points[4][2] = {
+                {center_x + x, center_y + y}, {center_x - x, center_y + y},
+                {center_x + x, center_y - y}, {center_x - x, center_y - y},
+            };
+            for (const auto& [px, py] : points)
+            {
+                if (px >= clip.x_min && px <= clip.x_max && py >= clip.y_min && py <= clip.y_max)
+                    plot(static_cast<int>(px), static_cast<int>(py));
+            }
+        };
+
+        // Алгоритм средней точки; решающие величины умножены на 4,
+        // чтобы обойтись целыми числами. Они доходят до 4 * rx^2 * ry^2 и
+        // считаются в WideInt: при радиусах до INT_MAX это меньше 2^127
+        const WideInt rx2 = static_cast<WideInt>(radius_x) * radius_x;
+        const WideInt ry2 = static_cast<WideInt>(radius_y) * radius_y;
+        long long x = 0;
+        long long y = radius_y;
+        WideInt step_x = 0;
+        WideInt step_y = 2 * rx2 * y;
+
+        WideInt d1 = 4 * ry2 - 4 * rx2 * radius_y + rx2;
+        while (step_x < step_y)
+        {
+            plot_quadrants(x, y);
+            ++x;
+            step_x += 2 * ry2;
+            if (d1 < 0)
+            {
+                d1 += 4 * (step_x + ry2);
+            }
+            else
+            {
+                --y;
+                step_y -= 2 * rx2;
+                d1 += 4 * (step_x - step_y + ry2);
+            }
+        }
+
+        WideInt d2 = ry2 * (2 * x + 1) * (2 * x + 1) + 4 * rx2 * (y - 1) * (y - 1) - 4 * rx2 * ry2;
+        while (y >= 0)
+        {
+            plot_quadrants(x, y);
+            --y;
+            step_y -= 2 * rx2;
+            if (d2 > 0)
+            {
+                d2 += 4 * (rx2 - step_y);
+            }
+            else
+            {
+                ++x;
+                step_x += 2 * ry2;
+                d2 += 4 * (step_x - step_y + rx2);
+            }
+        }
+    }
+
+    template <typename FillSpan>
+    static void FilledTriangle(const int x1, const int y1, int x2, int y2,
+                               int x3, int y3, const ClipRect& clip,
+                               FillSpan fill)
+    {
+        // Приводим обход к одному направлению, чтобы заливка не зависела
+        // от порядка вершин; вырожденный треугольник ничего не закрашивает
+        if (Cross(x1, y1, x2, y2, x3, y3) < 0)
+        {
+            std::swap(x2, x3);
+            std::swap(y2, y3);
+        }
+        if (Cross(x1, y1, x2, y2, x3, y3) == 0)
+            return;
+
+        const int left = std::max(std::min({x1, x2, x3}), clip.x_min);
+        const int right = std::min(std::max({x1, x2, x3}), clip.x_max);
+        const int top = std::max(std::min({y1, y2, y3}), clip.y_min);
+        const int bottom = std::min(std::max({y1, y2, y3}), clip.y_max);
+        if (left > right || top > bottom)
+            return;
+
+        Edge edges[3] = {
+            Edge(x1, y1, x2, y2, top),
+            Edge(x2, y2, x3, y3, top),
+            Edge(x3, y3, x1, y1, top),
+        };
+
+        for (int y = top; y <= bottom; ++y)
+        {
+            long long span_begin = left;
+            long long span_end = right;
+            for (Edge& edge : edges)
+            {
+                edge.Clip(span_begin, span_end);
+                edge.NextRow();
+            }
+
+            if (span_begin <= span_end)
+            {
+                fill(y, static_cast<int>(span_begin), static_cast<int>(span_end));
+            }
+        }
+    }
+
+    template <typename FillSpan>
+    static void FilledRectangle(const int x1, const int y1, const int x2,
+                                const int y2, const ClipRect& clip,
+                                FillSpan fill)
+    {
+        const int left = std::max(std::min(x1, x2), clip.x_min);
+        const int right = std::min(std::max(x1, x2), clip.x_max);
+        const int top = std::max(std::min(y1, y2), clip.y_min);
+        const int bottom = std::min(std::max(y1, y2), clip.y_max);
+
+        if (left > right)
+            return;
+
+        for (int y = top; y <= bottom; ++y)
+        {
+            fill(y, left, right);
+        }
+    }
+
+private:
+    // Целое для произведений четвертой степени координат
+    __extension__ using WideInt = __int128;
+
+    // Номера шагов [first, last] из [0, steps], на которых координата
+    // start + sign * k лежит в [clip_min, clip_max]
+    static std::pair<long long, long long> StepRange(const long long start, const int sign,
+                                                     const long long clip_min, const long long clip_max,
+                                                     const long long steps) noexcept
+    {
+        const long long first = sign > 0 ? clip_min - start : start - clip_max;
+        const long long last = sign > 0 ? clip_max - start : start - clip_min;
+        return { std::max(first, 0LL), std::min(last, steps) };
+    }
+
+    static long long Cross(const long long x1, const long long y1,
+                           const long long x2, const long long y2,
+                           const long long x3, const long long y3) noexcept
+    {
+        return (x3 - x1) * (y2 - y1) - (y3 - y1) * (x2 - x1);
+    }
+
+    static long long FloorDiv(const long long a, const long long b) noexcept
+    {
+        const long long q = a / b;
+        return (a % b != 0 && (a < 0) != (b < 0)) ? q - 1 : q;
+    }
+
+    // Ребро треугольника: E(x, y) = (x - xa) * dy - (y - ya) * dx.
+    // Внутренние точки дают E >= 0, а точки на самом ребре закрашиваются
+    // только для левых и верхних ребер (top-left fill rule)
+    class Edge
+    {
+    public:
+        Edge(const int xa, const int ya, const int xb, const int yb,
+             const int first_row)
+            : dx_(static_cast<long long>(xb) - xa),
+              dy_(static_cast<long long>(yb) - ya)
+        {
+            const bool top_left = dy_ > 0 || (dy_ == 0 && dx_ < 0);
+            row_value_ = -xa * dy_ - (first_row - static_cast<long long>(ya)) * dx_ -
+                         (top_left ? 0 : 1);
+        }
+
+        void Clip(long long& span_begin, long long& span_end) const noexcept
+        {
+            // Условие dy * x + row_value >= 0 на текущей строке
+            if (dy_ > 0)
+            {
+                span_begin = std::max(span_begin, -FloorDiv(row_value_, dy_));
+            }
+            else if (dy_ < 0)
+            {
+                span_end = std::min(span_end, FloorDiv(row_value_, -dy_));
+            }
+            else if (row_value_ < 0)
+            {
+                span_end = span_begin - 1;
+            }
+        }
+
+        void NextRow() noexcept
+        {
+            row_value_ -= dx_;
+        }
+
+    private:
+        long long dx_;
+        long long dy_;
+        long long row_value_;
+    };
+};
+
+} // namespace plotter
\ No newline at end of file
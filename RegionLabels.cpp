@@ -0,0 +1,237 @@
+#include "RegionLabels.hpp"
+#include "ThreadPool.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+namespace plotter
+{
+
+namespace
+{
+
+uint32_t FindRoot(std::vector<uint32_t>& parent, uint32_t run) noexcept
+{
+    while (parent[run] != run)
+    {
+        parent[run] = parent[parent[run]];
+        run = parent[run];
+    }
+    return run;
+}
+
+// Корень - наименьший отрезок множества: он встречается первым при обходе
+void Unite(std::vector<uint32_t>& parent, const uint32_t a, const uint32_t b) noexcept
+{
+    const uint32_t root_a = FindRoot(parent, a);
+    const uint32_t root_b = FindRoot(parent, b);
+    if (root_a < root_b)
+    {
+        parent[root_b] = root_a;
+    }
+    else if (root_b < root_a)
+    {
+        parent[root_a] = root_b;
+    }
+}
+
+// Объединяет перекрывающиеся отрезки одного символа в соседних строках
+// [upper, upper_end) и [lower, lower_end). Обход держит текущие отрезки
+// обеих строк перекрытыми и сдвигает тот, что кончается раньше
+void ConnectRows(const std::vector<int>& xs, const std::vector<char>& chars, std::vector<uint32_t>& parent,
+                 uint32_t upper, const uint32_t upper_end, uint32_t lower, const uint32_t lower_end,
+                 const int width) noexcept
+{
+    while (upper < upper_end && lower < lower_end)
+    {
+        if (chars[upper] == chars[lower])
+        {
+            Unite(parent, upper, lower);
+        }
+
+        const int upper_last = upper + 1 < upper_end ? xs[upper + 1] : width;
+        const int lower_last = lower + 1 < lower_end ? xs[lower + 1] : width;
+        if (upper_last <= lower_last)
+        {
+            ++upper;
+        }
+        if (lower_last <= upper_last)
+        {
+            ++lower;
+        }
+    }
+}
+
+} // namespace
+
+RegionLabels::RegionLabels(const Canvas& canvas, ThreadPool* pool)
+    : canvas_(&canvas), revision_(canvas.Revision()), width_(canvas.Width()), height_(canvas.Height()),
+      row_begin_(static_cast<size_t>(std::max(height_, 0)) + 1, 0)
+{
+    if (width_ <= 0 || height_ <= 0)
+    {
+        return;
+    }
+
+    // Отрезки и множества полосы с локальными номерами; индекс - первая строка полосы
+    struct Band
+    {
+        std::vector<int> xs;
+        std::vector<char> chars;
+        std::vector<uint32_t> parent;
+    };
+    std::vector<Band> bands(height_);
+    const char* data = canvas.Data();
+
+    ThreadPool::ForEachBand(pool, height_, 1, [&](const int y_begin, const int y_end)
+    {
+        Band& band = bands[y_begin];
+        std::vector<char> scratch(data ? 0 : width_);
+        uint32_t previous = 0;
+        for (int y = y_begin; y < y_end; ++y)
+        {
+            const char* row = data ? data + static_cast<size_t>(y) * width_ : scratch.data();
+            if (!data)
+            {
+                canvas.ReadRow(0, y, width_, scratch.data());
+            }
+
+            const auto first = static_cast<uint32_t>(band.xs.size());
+            for (int x = 0; x < width_;)
+            {
+                const char pixel = row[x];
+                band.xs.push_back(x);
+                band.chars.push_back(pixel);
+                band.parent.push_back(static_cast<uint32_t>(band.parent.size()));
+                do
+                {
+                    ++x;
+                } while (x < width_ && row[x] == pixel);
+            }
+
+            const auto last = static_cast<uint32_t>(band.xs.size());
+            row_begin_[y + 1] = last - first;
+            if (y > y_begin)
+            {
+                ConnectRows(band.xs, band.chars, band.parent, previous, first, first, last, width_);
+            }
+            previous = first;
+        }
+    });
+
+    for (int y = 0; y < height_; ++y)
+    {
+        row_begin_[y + 1] += row_begin_[y];
+    }
+
+    const size_t run_count = row_begin_[height_];
+    run_x_.resize(run_count);
+    run_label_.resize(run_count);
+    std::vector<char> chars(run_count);
+    std::vector<uint32_t> parent(run_count);
+
+    // Сшивка: полосы копируются на свои места, затем объединяются их границы
+    std::vector<int> band_starts;
+    for (int y = 0; y < height_; ++y)
+    {
+        Band& band = bands[y];
+        if (band.xs.empty())
+        {
+            continue;
+        }
+
+        const uint32_t offset = row_begin_[y];
+        std::copy(band.xs.begin(), band.xs.end(), run_x_.begin() + offset);
+        std::copy(band.chars.begin(), band.chars.end(), chars.begin() + offset);
+        std::transform(band.parent.begin(), band.parent.end(), parent.begin() + offset,
+                       [offset](const uint32_t run) { return run + offset; });
+        band = {};
+        band_starts.push_back(y);
+    }
+    for (const int y : band_starts)
+    {
+        if (y > 0)
+        {
+            ConnectRows(run_x_, chars, parent, row_begin_[y - 1], row_begin_[y], row_begin_[y],
+                        row_begin_[y + 1], width_);
+        }
+    }
+
+    // Второй проход: корни ищутся параллельно без записи в parent
+    ThreadPool::ForEachBand(pool, height_, 1, [&](const int y_begin, const int y_end)
+    {
+        for (uint32_t run = row_begin_[y_begin]; run < row_begin_[y_end]; ++run)
+        {
+            uint32_t root = run;
+            while (parent[root] != root)
+            {
+                root = parent[root];
+            }
+            run_label_[run] = root;
+        }
+    });
+
+    // Корень предшествует своим отрезкам, поэтому его метка уже известна;
+    // parent больше не нужен и хранит метку корня
+    for (int y = 0; y < height_; ++y)
+    {
+        for (uint32_t run = row_begin_[y]; run < row_begin_[y + 1]; ++run)
+        {
+            const uint32_t root = run_label_[run];
+            if (root == run)
+            {
+                parent[run] = static_cast<uint32_t>(region_chars_.size());
+                region_chars_.push_back(chars[run]);
+                region_areas_.push_back(0);
+                region_enclosed_.push_back(1);
+            }
+
+            const uint32_t label = parent[root];
+            run_label_[run] = label;
+            const int x_end = RunEnd(run, y);
+            region_areas_[label] += x_end - run_x_[run] + 1;
+            if (y == 0 || y == height_ - 1 || run_x_[run] == 0 || x_end == width_ - 1)
+            {
+                region_enclosed_[label] = 0;
+            }
+        }
+    }
+}
+
+[[nodiscard]] uint32_t RegionLabels::Label(const int x, const int y) const
+{
+    if (x < 0 || x >= width_ || y < 0 || y >= height_)
+    {
+        throw std::out_of_range("pixel (" + std::to_string(x) + ", " +
+                                std::to_string(y) + ") is out of canvas");
+    }
+
+    const auto first = run_x_.begin() + row_begin_[y];
+    const auto last = run_x_.begin() + row_begin_[y + 1];
+    return run_label_[std::upper_bound(first, last, x) - run_x_.begin() - 1];
+}
+
+void RegionLabels::ForEachSelectedRun(const std::vector<char>& selected, ThreadPool* pool,
+                                      const std::function<void(int, int, int)>& run) const
+{
+    ThreadPool::ForEachBand(pool, height_, Canvas::kTileSize, [&](const int y_begin, const int y_end)
+    {
+        for (int y = y_begin; y < y_end; ++y)
+        {
+            for (uint32_t index = row_begin_[y]; index < row_begin_[y + 1]; ++index)
+            {
+                if (selected[run_label_[index]])
+                {
+                    run(y, run_x_[index], RunEnd(index, y));
+                }
+            }
+        }
+    });
+}
+
+[[nodiscard]] int RegionLabels::RunEnd(const uint32_t run, const int y) const noexcept
+{
+    return run + 1 < row_begin_[y + 1] ? run_x_[run + 1] - 1 : width_ - 1;
+}
+
+} // namespace plotter
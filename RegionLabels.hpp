@@ -0,0 +1,65 @@
+#pragma once
+#include "Canvas.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace plotter
+{
+
+class ThreadPool;
+
+// Разметка всех связных (по 4 соседям) областей одного символа холста.
+// Строки разбиваются на отрезки одного символа; полосы строк размечаются
+// параллельно системой непересекающихся множеств над отрезками, затем
+// сшиваются границы полос и метки сжимаются в номера 0..RegionCount()-1
+// в порядке первого отрезка области (сверху вниз, слева направо).
+// Разметка остается верной, пока не изменился Revision() холста
+class RegionLabels
+{
+public:
+    explicit RegionLabels(const Canvas& canvas, ThreadPool* pool = nullptr);
+
+    [[nodiscard]] int Width() const noexcept { return width_; }
+    [[nodiscard]] int Height() const noexcept { return height_; }
+    [[nodiscard]] size_t RegionCount() const noexcept { return region_chars_.size(); }
+    [[nodiscard]] size_t RunCount() const noexcept { return run_x_.size(); }
+
+    // Разметка сделана по этому холсту и он с тех пор не менялся
+    [[nodiscard]] bool IsCurrent(const Canvas& canvas) const noexcept
+    {
+        return &canvas == canvas_ && canvas.Revision() == revision_;
+    }
+
+    // Точка вне холста - std::out_of_range
+    [[nodiscard]] uint32_t Label(int x, int y) const;
+    [[nodiscard]] char RegionChar(uint32_t label) const noexcept { return region_chars_[label]; }
+    [[nodiscard]] size_t RegionArea(uint32_t label) const noexcept { return region_areas_[label]; }
+    // Область не касается края холста
+    [[nodiscard]] bool IsEnclosed(uint32_t label) const noexcept { return region_enclosed_[label] != 0; }
+
+    // Вызывает run(y, x_begin, x_end) для каждого отрезка областей, отмеченных
+    // в selected (индекс - метка). Полосы строк кратны Canvas::kTileSize и
+    // обходятся на пуле, поэтому run может писать в свои строки холста
+    void ForEachSelectedRun(const std::vector<char>& selected, ThreadPool* pool,
+                            const std::function<void(int, int, int)>& run) const;
+
+private:
+    const Canvas* canvas_;
+    uint64_t revision_;
+    int width_;
+    int height_;
+    // Отрезки строки y - [row_begin_[y], row_begin_[y + 1]); отрезок
+    // кончается там, где начинается следующий в той же строке
+    std::vector<uint32_t> row_begin_;
+    std::vector<int> run_x_;
+    std::vector<uint32_t> run_label_;
+    std::vector<char> region_chars_;
+    std::vector<size_t> region_areas_;
+    std::vector<char> region_enclosed_;
+
+    [[nodiscard]] int RunEnd(uint32_t run, int y) const noexcept;
+};
+
+} // namespace plotter
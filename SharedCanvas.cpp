@@ -0,0 +1,64 @@
+#include "SharedCanvas.hpp"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace plotter
+{
+
+SharedCanvasReader::SharedCanvasReader(const std::string& name)
+{
+    const int fd = ::shm_open(name.c_str(), O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        throw std::runtime_error("failed to open shared canvas " + name + ": " + std::strerror(errno));
+    }
+
+    struct stat info{};
+    if (::fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < SharedFrameHeader::kBufferOffset)
+    {
+        ::close(fd);
+        throw std::runtime_error("shared canvas " + name + " is truncated");
+    }
+
+    length_ = static_cast<size_t>(info.st_size);
+    void* base = ::mmap(nullptr, length_, PROT_READ, MAP_SHARED, fd, 0);
+    const int error = errno;
+    ::close(fd);
+    if (base == MAP_FAILED)
+    {
+        throw std::runtime_error("failed to map shared canvas " + name + ": " + std::strerror(error));
+    }
+    header_ = static_cast<const SharedFrameHeader*>(base);
+
+    const size_t frame_size = static_cast<size_t>(header_->width) * header_->height;
+    if (std::memcmp(header_->magic, SharedFrameHeader::kMagic, sizeof(header_->magic)) != 0 ||
+        header_->version != SharedFrameHeader::kVersion || header_->width <= 0 || header_->height <= 0 ||
+        length_ < SharedFrameHeader::kBufferOffset + 2 * frame_size)
+    {
+        ::munmap(base, length_);
+        throw std::runtime_error("shared memory " + name + " does not hold a canvas");
+    }
+}
+
+SharedCanvasReader::~SharedCanvasReader()
+{
+    ::munmap(const_cast<SharedFrameHeader*>(header_), length_);
+}
+
+[[nodiscard]] uint64_t SharedCanvasReader::LatestFrame() const noexcept
+{
+    return header_->frame.load(std::memory_order_acquire);
+}
+
+[[nodiscard]] const char* SharedCanvasReader::Buffer(const uint32_t index) const noexcept
+{
+    return reinterpret_cast<const char*>(header_) + SharedFrameHeader::kBufferOffset +
+           static_cast<size_t>(index) * Width() * Height();
+}
+
+} // namespace plotter
@@ -0,0 +1,82 @@
+#pragma once
+#include "CanvasView.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace plotter
+{
+
+// Заголовок сегмента общей памяти с холстом. За ним лежат два буфера кадра
+// по width * height байт: готовый кадр (front) и тот, в котором рисует
+// писатель. Смена кадра защищена seqlock: sequence нечетный, пока писатель
+// переключает буферы, и меняется при каждой публикации
+struct SharedFrameHeader
+{
+    static constexpr char kMagic[4] = { 'A', 'C', 'S', 'H' };
+    static constexpr uint32_t kVersion = 1;
+    static constexpr size_t kBufferOffset = 64;
+
+    char magic[4];
+    uint32_t version;
+    int32_t width;
+    int32_t height;
+    char background;
+    std::atomic<uint64_t> sequence;
+    std::atomic<uint64_t> frame;
+    std::atomic<uint32_t> front;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+              "shared frame header needs address-free atomics");
+static_assert(sizeof(SharedFrameHeader) <= SharedFrameHeader::kBufferOffset);
+
+// Читатель холста, опубликованного другим процессом через Canvas::CreateShared.
+// Отображает сегмент только на чтение и отдает готовый кадр без копирования
+class SharedCanvasReader
+{
+public:
+    explicit SharedCanvasReader(const std::string& name);
+    ~SharedCanvasReader();
+
+    SharedCanvasReader(const SharedCanvasReader&) = delete;
+    SharedCanvasReader& operator=(const SharedCanvasReader&) = delete;
+
+    [[nodiscard]] int Width() const noexcept { return header_->width; }
+    [[nodiscard]] int Height() const noexcept { return header_->height; }
+    [[nodiscard]] char Background() const noexcept { return header_->background; }
+    // Число кадров, опубликованных писателем
+    [[nodiscard]] uint64_t LatestFrame() const noexcept;
+
+    // Вызывает read(ConstCanvasView, frame) прямо над буфером последнего
+    // готового кадра. false означает, что писатель успел переписать буфер
+    // во время чтения и результат read нужно отбросить
+    template <typename Read>
+    bool ReadFrame(Read&& read) const;
+
+private:
+    const SharedFrameHeader* header_ = nullptr;
+    size_t length_ = 0;
+
+    [[nodiscard]] const char* Buffer(uint32_t index) const noexcept;
+};
+
+template <typename Read>
+bool SharedCanvasReader::ReadFrame(Read&& read) const
+{
+    const uint64_t sequence = header_->sequence.load(std::memory_order_acquire);
+    if (sequence & 1)
+    {
+        return false;
+    }
+
+    const uint32_t front = header_->front.load(std::memory_order_relaxed);
+    const uint64_t frame = header_->frame.load(std::memory_order_relaxed);
+    read(ConstCanvasView(Buffer(front), Width(), Height(), Width()), frame);
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return header_->sequence.load(std::memory_order_relaxed) == sequence;
+}
+
+} // namespace plotter
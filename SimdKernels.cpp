@@ -0,0 +1,611 @@
+#include "SimdKernels.hpp"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PLOTTER_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+namespace plotter
+{
+
+namespace
+{
+
+using CorrelateFn = void (*)(const double*, const double*, int, double*, size_t);
+using MultiplyAddFn = void (*)(const double*, double, double*, size_t);
+using ScaleClampFn = void (*)(const double*, double, double*, size_t);
+using ThresholdFn = void (*)(double*, double, size_t);
+using InvertFn = void (*)(double*, size_t);
+using RemapBytesFn = void (*)(const char*, char*, size_t);
+using DecodeLevelsFn = void (*)(const double*, const char*, double*, size_t);
+using QuantizeLevelsFn = void (*)(const double*, const char*, int, char*, size_t);
+using CountRunFn = size_t (*)(const char*, char, size_t);
+
+struct KernelTable
+{
+    CorrelateFn correlate;
+    MultiplyAddFn multiply_add;
+    ScaleClampFn scale_clamp;
+    ThresholdFn threshold;
+    InvertFn invert;
+    RemapBytesFn remap_bytes;
+    DecodeLevelsFn decode_levels;
+    QuantizeLevelsFn quantize_levels;
+    CountRunFn count_leading;
+    CountRunFn count_trailing;
+};
+
+// Скалярные версии задают эталонный порядок операций: векторные версии
+// выполняют те же умножения и сложения в том же порядке для каждого пикселя
+namespace scalar
+{
+
+void Correlate(const double* src, const double* kernel, const int kernel_size, double* dst, const size_t count)
+{
+    for (size_t x = 0; x < count; ++x)
+    {
+        double sum = 0.0;
+        for (int k = 0; k < kernel_size; ++k)
+        {
+            sum += src[x + k] * kernel[k];
+        }
+        dst[x] = sum;
+    }
+}
+
+void MultiplyAdd(const double* src, const double weight, double* dst, const size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        dst[i] += src[i] * weight;
+    }
+}
+
+double ClampUnit(const double value)
+{
+    return value > 0.0 ? std::min(value, 1.0) : 0.0;
+}
+
+void ScaleClamp(const double* src, const double factor, double* dst, const size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        dst[i] = ClampUnit(src[i] * factor);
+    }
+}
+
+void Threshold(double* data, const double threshold, const size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        data[i] = data[i] >= threshold ? 1.0 : 0.0;
+    }
+}
+
+void Invert(double* data, const size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        data[i] = 1.0 - data[i];
+    }
+}
+
+void RemapBytes(const char* table, char* data, const size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        data[i] = table[static_cast<unsigned char>(data[i])];
+    }
+}
+
+void DecodeLevels(const double* table, const char* src, double* dst, const size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        dst[i] = table[static_cast<unsigned char>(src[i])];
+    }
+}
+
+void QuantizeLevels(const double* src, const char* level_to_char, const int max_level, char* dst, const size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        const int idx = static_cast<int>(ClampUnit(src[i]) * max_level);
+        dst[i] = level_to_char[std::min(idx, max_level)];
+    }
+}
+
+size_t CountLeading(const char* data, const char value, const size_t count)
+{
+    size_t i = 0;
+    while (i < count && data[i] == value)
+    {
+        ++i;
+    }
+    return i;
+}
+
+size_t CountTrailing(const char* data, const char value, const size_t count)
+{
+    size_t i = 0;
+    while (i < count && data[count - 1 - i] == value)
+    {
+        ++i;
+    }
+    return i;
+}
+
+constexpr KernelTable kTable = {
+    Correlate, MultiplyAdd, ScaleClamp, Threshold, Invert, RemapBytes, DecodeLevels, QuantizeLevels,
+    CountLeading, CountTrailing,
+};
+
+} // namespace scalar
+
+#ifdef PLOTTER_SIMD_X86
+
+namespace sse42
+{
+
+__attribute__((target("sse4.2"))) void Correlate(const double* src, const double* kernel, const int kernel_size,
+    double* dst, const size_t count)
+{
+    size_t x = 0;
+    for (; x + 2 <= count; x += 2)
+    {
+        __m128d sum = _mm_setzero_pd();
+        for (int k = 0; k < kernel_size; ++k)
+        {
+            sum = _mm_add_pd(sum, _mm_mul_pd(_mm_loadu_pd(src + x + k), _mm_set1_pd(kernel[k])));
+        }
+        _mm_storeu_pd(dst + x, sum);
+    }
+    scalar::Correlate(src + x, kernel, kernel_size, dst + x, count - x);
+}
+
+__attribute__((target("sse4.2"))) void MultiplyAdd(const double* src, const double weight, double* dst,
+    const size_t count)
+{
+    const __m128d w = _mm_set1_pd(weight);
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2)
+    {
+        _mm_storeu_pd(dst + i, _mm_add_pd(_mm_loadu_pd(dst + i), _mm_mul_pd(_mm_loadu_pd(src + i), w)));
+    }
+    scalar::MultiplyAdd(src + i, weight, dst + i, count - i);
+}
+
+__attribute__((target("sse4.2"))) void ScaleClamp(const double* src, const double factor, double* dst,
+    const size_t count)
+{
+    const __m128d f = _mm_set1_pd(factor);
+    const __m128d zero = _mm_setzero_pd();
+    const __m128d one = _mm_set1_pd(1.0);
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2)
+    {
+        const __m128d v = _mm_mul_pd(_mm_loadu_pd(src + i), f);
+        _mm_storeu_pd(dst + i, _mm_min_pd(_mm_max_pd(v, zero), one));
+    }
+    scalar::ScaleClamp(src + i, factor, dst + i, count - i);
+}
+
+__attribute__((target("sse4.2"))) void Threshold(double* data, const double threshold, const size_t count)
+{
+    const __m128d t = _mm_set1_pd(threshold);
+    const __m128d one = _mm_set1_pd(1.0);
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2)
+    {
+        const __m128d mask = _mm_cmpge_pd(_mm_loadu_pd(data + i), t);
+        _mm_storeu_pd(data + i, _mm_and_pd(mask, one));
+    }
+    scalar::Threshold(data + i, threshold, count - i);
+}
+
+__attribute__((target("sse4.2"))) void Invert(double* data, const size_t count)
+{
+    const __m128d one = _mm_set1_pd(1.0);
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2)
+    {
+        _mm_storeu_pd(data + i, _mm_sub_pd(one, _mm_loadu_pd(data + i)));
+    }
+    scalar::Invert(data + i, count - i);
+}
+
+// Таблица на 256 байт раскладывается на 16 таблиц по 16 байт: младший полубайт
+// выбирает элемент через pshufb, старший - какую из таблиц взять
+__attribute__((target("sse4.2"))) void RemapBytes(const char* table, char* data, const size_t count)
+{
+    __m128i parts[16];
+    for (int i = 0; i < 16; ++i)
+    {
+        parts[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(table + i * 16));
+    }
+
+    const __m128i low_mask = _mm_set1_epi8(0x0F);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        const __m128i low = _mm_and_si128(v, low_mask);
+        const __m128i high = _mm_and_si128(_mm_srli_epi16(v, 4), low_mask);
+
+        __m128i result = _mm_setzero_si128();
+        for (int part = 0; part < 16; ++part)
+        {
+            const __m128i selected = _mm_cmpeq_epi8(high, _mm_set1_epi8(static_cast<char>(part)));
+            result = _mm_or_si128(result, _mm_and_si128(selected, _mm_shuffle_epi8(parts[part], low)));
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(data + i), result);
+    }
+    scalar::RemapBytes(table, data + i, count - i);
+}
+
+__attribute__((target("sse4.2"))) void QuantizeLevels(const double* src, const char* level_to_char,
+    const int max_level, char* dst, const size_t count)
+{
+    const __m128d zero = _mm_setzero_pd();
+    const __m128d one = _mm_set1_pd(1.0);
+    const __m128d scale = _mm_set1_pd(max_level);
+    const __m128i limit = _mm_set1_epi32(max_level);
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2)
+    {
+        const __m128d v = _mm_min_pd(_mm_max_pd(_mm_loadu_pd(src + i), zero), one);
+        const __m128i idx = _mm_min_epi32(_mm_cvttpd_epi32(_mm_mul_pd(v, scale)), limit);
+        dst[i] = level_to_char[_mm_cvtsi128_si32(idx)];
+        dst[i + 1] = level_to_char[_mm_extract_epi32(idx, 1)];
+    }
+    scalar::QuantizeLevels(src + i, level_to_char, max_level, dst + i, count - i);
+}
+
+// Маска совпадений 16 байт: первое несовпадение - младший нулевой бит
+__attribute__((target("sse4.2"))) size_t CountLeading(const char* data, const char value, const size_t count)
+{
+    const __m128i pattern = _mm_set1_epi8(value);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        const auto mismatch = static_cast<uint32_t>(~_mm_movemask_epi8(_mm_cmpeq_epi8(v, pattern))) & 0xFFFF;
+        if (mismatch != 0)
+        {
+            return i + std::countr_zero(mismatch);
+        }
+    }
+    return i + scalar::CountLeading(data + i, value, count - i);
+}
+
+__attribute__((target("sse4.2"))) size_t CountTrailing(const char* data, const char value, const size_t count)
+{
+    const __m128i pattern = _mm_set1_epi8(value);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + count - i - 16));
+        const auto mismatch = static_cast<uint32_t>(~_mm_movemask_epi8(_mm_cmpeq_epi8(v, pattern))) & 0xFFFF;
+        if (mismatch != 0)
+        {
+            return i + std::countl_zero(mismatch) - 16;
+        }
+    }
+    return i + scalar::CountTrailing(data, value, count - i);
+}
+
+constexpr KernelTable kTable = {
+    Correlate, MultiplyAdd, ScaleClamp, Threshold, Invert, RemapBytes, scalar::DecodeLevels, QuantizeLevels,
+    CountLeading, CountTrailing,
+};
+
+} // namespace sse42
+
+namespace avx2
+{
+
+__attribute__((target("avx2"))) void Correlate(const double* src, const double* kernel, const int kernel_size,
+    double* dst, const size_t count)
+{
+    size_t x = 0;
+    for (; x + 4 <= count; x += 4)
+    {
+        __m256d sum = _mm256_setzero_pd();
+        for (int k = 0; k < kernel_size; ++k)
+        {
+            sum = _mm256_add_pd(sum, _mm256_mul_pd(_mm256_loadu_pd(src + x + k), _mm256_set1_pd(kernel[k])));
+        }
+        _mm256_storeu_pd(dst + x, sum);
+    }
+    scalar::Correlate(src + x, kernel, kernel_size, dst + x, count - x);
+}
+
+__attribute__((target("avx2"))) void MultiplyAdd(const double* src, const double weight, double* dst,
+    const size_t count)
+{
+    const __m256d w = _mm256_set1_pd(weight);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        const __m256d product = _mm256_mul_pd(_mm256_loadu_pd(src + i), w);
+        _mm256_storeu_pd(dst + i, _mm256_add_pd(_mm256_loadu_pd(dst + i), product));
+    }
+    scalar::MultiplyAdd(src + i, weight, dst + i, count - i);
+}
+
+__attribute__((target("avx2"))) void ScaleClamp(const double* src, const double factor, double* dst,
+    const size_t count)
+{
+    const __m256d f = _mm256_set1_pd(factor);
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d one = _mm256_set1_pd(1.0);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        const __m256d v = _mm256_mul_pd(_mm256_loadu_pd(src + i), f);
+        _mm256_storeu_pd(dst + i, _mm256_min_pd(_mm256_max_pd(v, zero), one));
+    }
+    scalar::ScaleClamp(src + i, factor, dst + i, count - i);
+}
+
+__attribute__((target("avx2"))) void Threshold(double* data, const double threshold, const size_t count)
+{
+    const __m256d t = _mm256_set1_pd(threshold);
+    const __m256d one = _mm256_set1_pd(1.0);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        const __m256d mask = _mm256_cmp_pd(_mm256_loadu_pd(data + i), t, _CMP_GE_OQ);
+        _mm256_storeu_pd(data + i, _mm256_and_pd(mask, one));
+    }
+    scalar::Threshold(data + i, threshold, count - i);
+}
+
+__attribute__((target("avx2"))) void Invert(double* data, const size_t count)
+{
+    const __m256d one = _mm256_set1_pd(1.0);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        _mm256_storeu_pd(data + i, _mm256_sub_pd(one, _mm256_loadu_pd(data + i)));
+    }
+    scalar::Invert(data + i, count - i);
+}
+
+__attribute__((target("avx2"))) void RemapBytes(const char* table, char* data, const size_t count)
+{
+    __m256i parts[16];
+    for (int i = 0; i < 16; ++i)
+    {
+        parts[i] = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(table + i * 16)));
+    }
+
+    const __m256i low_mask = _mm256_set1_epi8(0x0F);
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32)
+    {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        const __m256i low = _mm256_and_si256(v, low_mask);
+        const __m256i high = _mm256_and_si256(_mm256_srli_epi16(v, 4), low_mask);
+
+        __m256i result = _mm256_setzero_si256();
+        for (int part = 0; part < 16; ++part)
+        {
+            const __m256i selected = _mm256_cmpeq_epi8(high, _mm256_set1_epi8(static_cast<char>(part)));
+            result = _mm256_or_si256(result, _mm256_and_si256(selected, _mm256_shuffle_epi8(parts[part], low)));
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(data + i), result);
+    }
+    sse42::RemapBytes(table, data + i, count - i);
+}
+
+__attribute__((target("avx2"))) void DecodeLevels(const double* table, const char* src, double* dst,
+    const size_t count)
+{
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        int packed = 0;
+        std::memcpy(&packed, src + i, sizeof(packed));
+        const __m128i idx = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(packed));
+        _mm256_storeu_pd(dst + i, _mm256_i32gather_pd(table, idx, sizeof(double)));
+    }
+    scalar::DecodeLevels(table, src + i, dst + i, count - i);
+}
+
+__attribute__((target("avx2"))) void QuantizeLevels(const double* src, const char* level_to_char,
+    const int max_level, char* dst, const size_t count)
+{
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d scale = _mm256_set1_pd(max_level);
+    const __m128i limit = _mm_set1_epi32(max_level);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        const __m256d v = _mm256_min_pd(_mm256_max_pd(_mm256_loadu_pd(src + i), zero), one);
+        const __m128i idx = _mm_min_epi32(_mm256_cvttpd_epi32(_mm256_mul_pd(v, scale)), limit);
+        alignas(16) int lanes[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(lanes), idx);
+        for (int lane = 0; lane < 4; ++lane)
+        {
+            dst[i + lane] = level_to_char[lanes[lane]];
+        }
+    }
+    scalar::QuantizeLevels(src + i, level_to_char, max_level, dst + i, count - i);
+}
+
+__attribute__((target("avx2"))) size_t CountLeading(const char* data, const char value, const size_t count)
+{
+    const __m256i pattern = _mm256_set1_epi8(value);
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32)
+    {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        const auto mismatch = ~static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, pattern)));
+        if (mismatch != 0)
+        {
+            return i + std::countr_zero(mismatch);
+        }
+    }
+    return i + sse42::CountLeading(data + i, value, count - i);
+}
+
+__attribute__((target("avx2"))) size_t CountTrailing(const char* data, const char value, const size_t count)
+{
+    const __m256i pattern = _mm256_set1_epi8(value);
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32)
+    {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + count - i - 32));
+        const auto mismatch = ~static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, pattern)));
+        if (mismatch != 0)
+        {
+            return i + std::countl_zero(mismatch);
+        }
+    }
+    return i + sse42::CountTrailing(data, value, count - i);
+}
+
+constexpr KernelTable kTable = {
+    Correlate, MultiplyAdd, ScaleClamp, Threshold, Invert, RemapBytes, DecodeLevels, QuantizeLevels,
+    CountLeading, CountTrailing,
+};
+
+} // namespace avx2
+
+#endif
+
+SimdKernels::Level DetectLevel() noexcept
+{
+#ifdef PLOTTER_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return SimdKernels::Level::Avx2;
+    }
+    if (__builtin_cpu_supports("sse4.2"))
+    {
+        return SimdKernels::Level::Sse42;
+    }
+#endif
+    return SimdKernels::Level::Scalar;
+}
+
+const KernelTable& TableFor(const SimdKernels::Level level) noexcept
+{
+    switch (level)
+    {
+#ifdef PLOTTER_SIMD_X86
+    case SimdKernels::Level::Avx2:
+        return avx2::kTable;
+    case SimdKernels::Level::Sse42:
+        return sse42::kTable;
+#endif
+    default:
+        return scalar::kTable;
+    }
+}
+
+// Набор инструкций определяется один раз при запуске программы
+const SimdKernels::Level detected_level = DetectLevel();
+// Таблицу читают потоки пула во время свертки, поэтому смена уровня
+// публикует ее атомарно: release в SetActiveLevel, acquire при вызове ядра
+std::atomic<SimdKernels::Level> active_level = detected_level;
+std::atomic<const KernelTable*> kernels = &TableFor(detected_level);
+
+const KernelTable& ActiveTable() noexcept
+{
+    return *kernels.load(std::memory_order_acquire);
+}
+
+} // namespace
+
+SimdKernels::Level SimdKernels::DetectedLevel() noexcept
+{
+    return detected_level;
+}
+
+SimdKernels::Level SimdKernels::ActiveLevel() noexcept
+{
+    return active_level.load(std::memory_order_relaxed);
+}
+
+void SimdKernels::SetActiveLevel(const Level level) noexcept
+{
+    const Level clamped = std::min(level, detected_level);
+    active_level.store(clamped, std::memory_order_relaxed);
+    kernels.store(&TableFor(clamped), std::memory_order_release);
+}
+
+const char* SimdKernels::LevelName(const Level level) noexcept
+{
+    switch (level)
+    {
+    case Level::Avx2:
+        return "AVX2";
+    case Level::Sse42:
+        return "SSE4.2";
+    default:
+        return "scalar";
+    }
+}
+
+void SimdKernels::Correlate(const double* src, const double* kernel, const int kernel_size, double* dst,
+    const size_t count)
+{
+    ActiveTable().correlate(src, kernel, kernel_size, dst, count);
+}
+
+void SimdKernels::MultiplyAdd(const double* src, const double weight, double* dst, const size_t count)
+{
+    ActiveTable().multiply_add(src, weight, dst, count);
+}
+
+void SimdKernels::ScaleClamp(const double* src, const double factor, double* dst, const size_t count)
+{
+    ActiveTable().scale_clamp(src, factor, dst, count);
+}
+
+void SimdKernels::Threshold(double* data, const double threshold, const size_t count)
+{
+    ActiveTable().threshold(data, threshold, count);
+}
+
+void SimdKernels::Invert(double* data, const size_t count)
+{
+    ActiveTable().invert(data, count);
+}
+
+void SimdKernels::RemapBytes(const char* table, char* data, const size_t count)
+{
+    ActiveTable().remap_bytes(table, data, count);
+}
+
+void SimdKernels::DecodeLevels(const double* table, const char* src, double* dst, const size_t count)
+{
+    ActiveTable().decode_levels(table, src, dst, count);
+}
+
+void SimdKernels::QuantizeLevels(const double* src, const char* level_to_char, const int max_level, char* dst,
+    const size_t count)
+{
+    ActiveTable().quantize_levels(src, level_to_char, max_level, dst, count);
+}
+
+size_t SimdKernels::CountLeading(const char* data, const char value, const size_t count)
+{
+    return ActiveTable().count_leading(data, value, count);
+}
+
+size_t SimdKernels::CountTrailing(const char* data, const char value, const size_t count)
+{
+    return ActiveTable().count_trailing(data, value, count);
+}
+
+} // namespace plotter
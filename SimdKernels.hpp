@@ -0,0 +1,39 @@
+#pragma once
+#include <cstddef>
+
+namespace plotter
+{
+
+class SimdKernels
+{
+public:
+    enum class Level
+    {
+        Scalar,
+        Sse42,
+        Avx2,
+    };
+
+    [[nodiscard]] static Level DetectedLevel() noexcept;
+    [[nodiscard]] static Level ActiveLevel() noexcept;
+    // Уровень можно менять и во время работы пула потоков: ядро, уже
+    // начатое в другом потоке, доработает на прежней таблице
+    static void SetActiveLevel(Level level) noexcept;
+    [[nodiscard]] static const char* LevelName(Level level) noexcept;
+
+    static void Correlate(const double* src, const double* kernel, int kernel_size, double* dst, size_t count);
+    static void MultiplyAdd(const double* src, double weight, double* dst, size_t count);
+    static void ScaleClamp(const double* src, double factor, double* dst, size_t count);
+    static void Threshold(double* data, double threshold, size_t count);
+    static void Invert(double* data, size_t count);
+
+    static void RemapBytes(const char* table, char* data, size_t count);
+    static void DecodeLevels(const double* table, const char* src, double* dst, size_t count);
+    static void QuantizeLevels(const double* src, const char* level_to_char, int max_level, char* dst, size_t count);
+
+    // Длина отрезка из байтов value в начале и в конце data[0, count)
+    [[nodiscard]] static size_t CountLeading(const char* data, char value, size_t count);
+    [[nodiscard]] static size_t CountTrailing(const char* data, char value, size_t count);
+};
+
+} // namespace plotter
\ No newline at end of file
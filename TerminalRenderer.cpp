@@ -0,0 +1,179 @@
+#include "TerminalRenderer.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace plotter
+{
+
+TerminalRenderer::TerminalRenderer(std::ostream& os, const double target_fps) : os_(os)
+{
+    SetTargetFps(target_fps);
+}
+
+void TerminalRenderer::SetTargetFps(const double target_fps)
+{
+    frame_interval_ = target_fps > 0.0
+        ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / target_fps))
+        : Clock::duration::zero();
+}
+
+bool TerminalRenderer::Present(const Canvas& frame)
+{
+    const auto now = Clock::now();
+    if (frame_interval_ > Clock::duration::zero() && now < next_frame_)
+    {
+        // Более ранний отложенный кадр заменяется этим
+        if (has_pending_)
+        {
+            ++dropped_frames_;
+        }
+        if (frame.IsTiled())
+        {
+            // Плиточный снимок делит плитки с кадром и копирует только их список
+            pending_ = std::make_unique<Canvas>(frame.Snapshot());
+        }
+        else
+        {
+            if (!pending_ || pending_->IsTiled() || pending_->Width() != frame.Width()
+                || pending_->Height() != frame.Height())
+            {
+                pending_ = std::make_unique<Canvas>(frame.Width(), frame.Height());
+            }
+            for (int y = 0; y < frame.Height(); ++y)
+            {
+                std::memcpy(pending_->Row(y).data(), frame.Row(y).data(), frame.Width());
+            }
+        }
+        has_pending_ = true;
+        return false;
+    }
+
+    Show(frame, now);
+    return true;
+}
+
+bool TerminalRenderer::PresentPending()
+{
+    const auto now = Clock::now();
+    if (!has_pending_ || (frame_interval_ > Clock::duration::zero() && now < next_frame_))
+    {
+        return false;
+    }
+    Show(*pending_, now);
+    return true;
+}
+
+bool TerminalRenderer::Flush()
+{
+    if (!has_pending_)
+    {
+        return false;
+    }
+    Show(*pending_, Clock::now());
+    return true;
+}
+
+void TerminalRenderer::Show(const Canvas& frame, const Clock::time_point now)
+{
+    // Выведенный кадр новее отложенного
+    has_pending_ = false;
+
+    output_.clear();
+    if (!front_ || front_->Width() != frame.Width() || front_->Height() != frame.Height())
+    {
+        RepaintAll(frame);
+    }
+    else
+    {
+        RepaintChanged(frame);
+    }
+
+    os_.write(output_.data(), static_cast<std::streamsize>(output_.size()));
+    os_.flush();
+
+    // Если терминал не успел принять кадр за интервал, следующий слот
+    // начинается после записи: кадры, пришедшие за это время, отбрасываются
+    next_frame_ = std::max(now + frame_interval_, Clock::now());
+    last_frame_bytes_ = output_.size();
+    ++presented_frames_;
+}
+
+void TerminalRenderer::RepaintAll(const Canvas& frame)
+{
+    front_ = std::make_unique<Canvas>(frame.Width(), frame.Height());
+
+    output_ += "\x1b[H\x1b[2J";
+    for (int y = 0; y < frame.Height(); ++y)
+    {
+        const char* row = FrameRow(frame, y);
+        MoveCursor(0, y);
+        output_.append(row, frame.Width());
+        std::memcpy(front_->Row(y).data(), row, frame.Width());
+    }
+}
+
+void TerminalRenderer::RepaintChanged(const Canvas& frame)
+{
+    const int width = frame.Width();
+    for (int y = 0; y < frame.Height(); ++y)
+    {
+        const char* row = FrameRow(frame, y);
+        char* shown = front_->Row(y).data();
+        if (std::memcmp(row, shown, width) == 0)
+            continue;
+
+        int x = 0;
+        while (x < width)
+        {
+            while (x < width && row[x] == shown[x])
+                ++x;
+            if (x == width)
+                break;
+
+            // Соседние измененные участки с коротким промежутком сливаются в один
+            int run_end = x + 1;
+            int gap = 0;
+            for (int i = run_end; i < width && gap < kMaxRunGap; ++i)
+            {
+                if (row[i] != shown[i])
+                {
+                    run_end = i + 1;
+                    gap = 0;
+                }
+                else
+                {
+                    ++gap;
+                }
+            }
+
+            MoveCursor(x, y);
+            output_.append(row + x, run_end - x);
+            std::memcpy(shown + x, row + x, run_end - x);
+            x = run_end;
+        }
+    }
+}
+
+const char* TerminalRenderer::FrameRow(const Canvas& frame, const int y)
+{
+    if (!frame.IsTiled())
+    {
+        return frame.Row(y).data();
+    }
+
+    // У плиточного холста строка не непрерывна - собираем ее
+    scratch_row_.resize(frame.Width());
+    frame.ReadRow(0, y, frame.Width(), scratch_row_.data());
+    return scratch_row_.data();
+}
+
+void TerminalRenderer::MoveCursor(const int x, const int y)
+{
+    output_ += "\x1b[";
+    output_ += std::to_string(y + 1);
+    output_ += ';';
+    output_ += std::to_string(x + 1);
+    output_ += 'H';
+}
+
+} // namespace plotter
@@ -0,0 +1,66 @@
+#pragma once
+#include "Canvas.hpp"
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+
+namespace plotter
+{
+
+class TerminalRenderer
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // target_fps <= 0 - без ограничения частоты кадров
+    explicit TerminalRenderer(std::ostream& os = std::cout, double target_fps = 0.0);
+
+    // Выводит кадр; возвращает false, если кадр пришел раньше своего слота.
+    // Такой кадр не теряется: последний из них копируется и выводится
+    // PresentPending в следующем слоте или Flush
+    bool Present(const Canvas& frame);
+    // Выводит отложенный кадр, если его слот уже наступил
+    bool PresentPending();
+    // Выводит отложенный кадр сразу, не дожидаясь слота: вызывается, когда
+    // новых кадров больше не будет, чтобы на экране остался последний
+    bool Flush();
+    [[nodiscard]] bool HasPendingFrame() const noexcept { return has_pending_; }
+    [[nodiscard]] Clock::time_point NextFrameTime() const noexcept { return next_frame_; }
+    // Следующий кадр будет перерисован целиком
+    void Invalidate() noexcept { front_.reset(); }
+
+    void SetTargetFps(double target_fps);
+
+    [[nodiscard]] size_t PresentedFrames() const noexcept { return presented_frames_; }
+    // Отброшенные кадры - отложенные, которые заменил более новый
+    [[nodiscard]] size_t DroppedFrames() const noexcept { return dropped_frames_; }
+    [[nodiscard]] size_t LastFrameBytes() const noexcept { return last_frame_bytes_; }
+
+private:
+    // Неизмененный промежуток короче этого дешевле переписать, чем двигать курсор
+    static constexpr int kMaxRunGap = 8;
+
+    std::ostream& os_;
+    std::unique_ptr<Canvas> front_;
+    // Последний кадр, пришедший раньше слота; буфер переиспользуется
+    std::unique_ptr<Canvas> pending_;
+    bool has_pending_ = false;
+    std::string output_;
+    std::string scratch_row_;
+
+    Clock::duration frame_interval_{};
+    Clock::time_point next_frame_{};
+
+    size_t presented_frames_ = 0;
+    size_t dropped_frames_ = 0;
+    size_t last_frame_bytes_ = 0;
+
+    void Show(const Canvas& frame, Clock::time_point now);
+    void RepaintAll(const Canvas& frame);
+    void RepaintChanged(const Canvas& frame);
+    const char* FrameRow(const Canvas& frame, int y);
+    void MoveCursor(int x, int y);
+};
+
+} // namespace plotter
@@ -0,0 +1,135 @@
+#include "ThreadPool.hpp"
+#include <algorithm>
+
+namespace plotter
+{
+
+ThreadPool::ThreadPool(const int thread_count)
+{
+    // Вызывающий поток тоже выполняет задачи, поэтому рабочих на один меньше
+    for (int i = 1; i < thread_count; ++i)
+    {
+        workers_.emplace_back([this] { WorkerLoop(); });
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard lock(mutex_);
+        stop_ = true;
+    }
+    work_available_.notify_all();
+    for (auto& worker : workers_)
+    {
+        worker.join();
+    }
+}
+
+void ThreadPool::ParallelFor(const int task_count, const std::function<void(int)>& task)
+{
+    if (workers_.empty() || task_count <= 1)
+    {
+        for (int i = 0; i < task_count; ++i)
+        {
+            task(i);
+        }
+        return;
+    }
+
+    auto job = std::make_shared<Job>();
+    job->task = &task;
+    job->task_count = task_count;
+    job->pending = task_count;
+    {
+        std::lock_guard lock(mutex_);
+        job_ = job;
+        ++generation_;
+    }
+    work_available_.notify_all();
+
+    RunTasks(*job);
+
+    std::unique_lock lock(mutex_);
+    job_done_.wait(lock, [&job] { return job->pending == 0; });
+    job_.reset();
+
+    if (job->error)
+    {
+        std::rethrow_exception(job->error);
+    }
+}
+
+void ThreadPool::ForEachBand(ThreadPool* pool, const int rows, const int alignment,
+                             const std::function<void(int, int)>& band)
+{
+    if (rows <= 0)
+    {
+        return;
+    }
+
+    const int threads = pool ? pool->ThreadCount() : 1;
+    int band_rows = std::max(kMinBandRows, (rows + threads * kBandsPerThread - 1) / (threads * kBandsPerThread));
+    band_rows = (band_rows + alignment - 1) / alignment * alignment;
+
+    if (threads == 1 || band_rows >= rows)
+    {
+        band(0, rows);
+        return;
+    }
+
+    const int band_count = (rows + band_rows - 1) / band_rows;
+    pool->ParallelFor(band_count, [&](const int i)
+                      { band(i * band_rows, std::min(rows, (i + 1) * band_rows)); });
+}
+
+void ThreadPool::WorkerLoop()
+{
+    uint64_t seen_generation = 0;
+    while (true)
+    {
+        std::shared_ptr<Job> job;
+        {
+            std::unique_lock lock(mutex_);
+            work_available_.wait(lock, [&] { return stop_ || generation_ != seen_generation; });
+            if (stop_)
+            {
+                return;
+            }
+            seen_generation = generation_;
+            job = job_;
+        }
+
+        if (job)
+        {
+            RunTasks(*job);
+        }
+    }
+}
+
+void ThreadPool::RunTasks(Job& job)
+{
+    for (int i = job.next_task++; i < job.task_count; i = job.next_task++)
+    {
+        try
+        {
+            (*job.task)(i);
+        }
+        catch (...)
+        {
+            std::lock_guard lock(mutex_);
+            if (!job.error)
+            {
+                job.error = std::current_exception();
+            }
+        }
+
+        if (--job.pending == 0)
+        {
+            std::lock_guard lock(mutex_);
+            job_done_.notify_all();
+        }
+    }
+}
+
+} // namespace plotter
\ No newline at end of file
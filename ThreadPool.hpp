@@ -0,0 +1,56 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace plotter
+{
+
+class ThreadPool
+{
+public:
+    explicit ThreadPool(int thread_count);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    [[nodiscard]] int ThreadCount() const noexcept { return static_cast<int>(workers_.size()) + 1; }
+
+    void ParallelFor(int task_count, const std::function<void(int)>& task);
+
+    static void ForEachBand(ThreadPool* pool, int rows, int alignment,
+                            const std::function<void(int, int)>& band);
+
+private:
+    static constexpr int kMinBandRows = 16;
+    static constexpr int kBandsPerThread = 4;
+
+    struct Job
+    {
+        const std::function<void(int)>* task;
+        int task_count;
+        std::atomic<int> next_task{0};
+        std::atomic<int> pending;
+        std::exception_ptr error;
+    };
+
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable work_available_;
+    std::condition_variable job_done_;
+    std::shared_ptr<Job> job_;
+    uint64_t generation_ = 0;
+    bool stop_ = false;
+
+    void WorkerLoop();
+    void RunTasks(Job& job);
+};
+
+} // namespace plotter
\ No newline at end of file
@@ -70,13 +70,19 @@ Node LoadArray(istream& input)
 
 Node LoadInt(istream& input)
 {
+    const bool negative = input.peek() == '-';
+    if (negative)
+    {
+        input.get();
+    }
+
     int result = 0;
     while (isdigit(input.peek()))
     {
         result *= 10;
         result += input.get() - '0';
     }
-    return Node(result);
+    return Node(negative ? -result : result);
 }
 
 Node LoadString(istream& input)